@@ -5,12 +5,15 @@
 #include "ast.h"
 #include "ast_type.h"
 #include "ast_decl.h"
-#include <string.h> // strdup, strcmp
+#include "ast_cache.h"
+#include "position_index.h"
 #include <stdio.h>  // printf
 
 Node::Node(yyltype loc) {
     location = new yyltype(loc);
     parent = NULL;
+    if (indexingPositions)
+        NotePosition(this);
 }
 
 Node::Node() {
@@ -18,10 +21,24 @@ Node::Node() {
     parent = NULL;
 }
 
+void Node::Save(AstWriter *out) {
+    Assert(0);  // only the nodes of a parse tree are saved
+}
+
 Identifier::Identifier(yyltype loc, const char *n) : Node(loc) {
-    name = strdup(n);
+    name = n;
+}
+
+void Identifier::Save(AstWriter *out) {
+    out->WriteTag(IdentifierTag);
+    out->WriteLocation(location);
+    out->WriteName(name);
+}
+
+Decl *Identifier::GetDecl() {
+    return (parent != NULL ? parent->GetDecl() : NULL);
 }
 
 bool Identifier::operator==(const Identifier &rhs) {
-    return strcmp(name, rhs.name) == 0 ? true : false;
+    return name == rhs.name;
 }
@@ -35,6 +35,9 @@
 #include <iostream>
 using namespace std;
 
+class AstWriter;
+class Decl;
+
 class Node  {
   protected:
     yyltype *location;
@@ -48,18 +51,28 @@ class Node  {
     yyltype *GetLocation()   { return location; }
     void SetParent(Node *p)  { parent = p; }
     Node *GetParent()        { return parent; }
+
+    // Returns the declaration that the node stands for or names, once
+    // the program is checked, or NULL if there is none
+    virtual Decl *GetDecl()  { return NULL; }
+
+    // Writes the node and its children out for the AST cache (see
+    // ast_cache.h)
+    virtual void Save(AstWriter *out);
 };
 
 class Identifier : public Node 
 {
   protected:
-    char *name;
+    const char *name; // interned, so equal names are the same pointer
 
   public:
-    Identifier(yyltype loc, const char *name);
+    Identifier(yyltype loc, const char *name); // name must be interned
     friend ostream& operator<<(ostream& out, Identifier *id) { return out << id->name; }
     bool operator==(const Identifier &rhs);
     const char* Name() { return name; }
+    Decl *GetDecl();            // that of the node it is the name in
+    void Save(AstWriter *out);
 };
 
 // This node class is designed to represent a portion of the tree that 
@@ -0,0 +1,499 @@
+/* File: ast_cache.cc
+ * ------------------
+ * Implementation of the AST cache. Nodes save themselves (see Save() in
+ * the ast headers); they are read back here, each by calling the
+ * constructor the parser would have, so the tree comes out the same,
+ * locations and parent links included.
+ */
+
+#include "ast_cache.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "ast_decl.h"
+#include "ast_expr.h"
+#include "ast_stmt.h"
+#include "ast_type.h"
+#include "cache.h"              // for BuildId
+#include "intern.h"
+#include "sha256.h"
+#include "source.h"
+#include "token_stream.h"       // for lineStarts
+#include "utility.h"
+using namespace std;
+
+static const uint32_t AstVersion = 1;
+
+struct AstHeader
+{
+    char magic[4];
+    uint32_t version;
+    char key[64];               // see KeyOf
+    uint32_t numLines;
+    uint32_t numNames;
+    uint32_t namesSize;         // bytes
+    uint64_t nodesSize;         // bytes
+};
+
+static string key;              // of the source being compiled
+static bool loaded;             // whether its tree came from the cache
+static List<Decl*> *parsed;     // see NoteParsedAst
+
+
+void AstWriter::WriteInt(int32_t value) {
+    nodes.append((const char *)&value, sizeof(value));
+}
+
+void AstWriter::WriteDouble(double value) {
+    nodes.append((const char *)&value, sizeof(value));
+}
+
+void AstWriter::WriteName(const char *name) {
+    pair<unordered_map<string, int32_t>::iterator, bool> added =
+        numbers.insert(make_pair(string(name), (int32_t)numbers.size()));
+    if (added.second)
+        names.append(name, strlen(name) + 1);
+    WriteInt(added.first->second);
+}
+
+void AstWriter::WriteLocation(yyltype *location) {
+    Assert(location != NULL);
+    WriteInt(location->first_line);
+    WriteInt(location->first_column);
+    WriteInt(location->last_line);
+    WriteInt(location->last_column);
+}
+
+void AstWriter::WriteNode(Node *node) {
+    if (node == NULL)
+        WriteTag(NullTag);
+    else
+        node->Save(this);
+}
+
+string AstWriter::Contents(const string &key,
+                           const vector<size_t> &lineStarts) {
+    AstHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "dAST", sizeof(header.magic));
+    header.version = AstVersion;
+    memcpy(header.key, key.data(), sizeof(header.key));
+    header.numLines = lineStarts.size();
+    header.numNames = numbers.size();
+    header.namesSize = names.size();
+    header.nodesSize = nodes.size();
+
+    string contents((const char *)&header, sizeof(header));
+    for (size_t i = 0; i < lineStarts.size(); i++) {
+        uint32_t start = lineStarts[i];
+        contents.append((const char *)&start, sizeof(start));
+    }
+    return contents + names + nodes;
+}
+
+
+/* Class: AstReader
+ * ----------------
+ * Reads a tree back from the node section of a cache file. Reading past
+ * the end or an unknown tag marks the reader failed, and from then on
+ * it reads nothing but NULL and zeros.
+ */
+class AstReader
+{
+  public:
+    AstReader(const char *p, const char *end, vector<const char*> &names)
+        : p(p), end(end), names(names), failed(false) {}
+
+    bool Failed() { return failed || p != end; }
+
+    template<class Element> List<Element> *ReadList() {
+        List<Element> *list = new List<Element>;
+        for (int n = ReadInt(); n > 0 && !failed; n--)
+            list->Append(static_cast<Element>(ReadNode()));
+        return list;
+    }
+
+    template<class T> T *Read() { return static_cast<T*>(ReadNode()); }
+
+  private:
+    const char *p, *end;
+    vector<const char*> &names;
+    bool failed;
+
+    bool Take(void *value, size_t n) {
+        if (failed || (size_t)(end - p) < n) {
+            failed = true;
+            memset(value, 0, n);
+            return false;
+        }
+        memcpy(value, p, n);
+        p += n;
+        return true;
+    }
+
+    int32_t ReadInt() { int32_t v; Take(&v, sizeof(v)); return v; }
+    double ReadDouble() { double v; Take(&v, sizeof(v)); return v; }
+
+    const char *ReadName() {
+        int32_t n = ReadInt();
+        if (n < 0 || (size_t)n >= names.size()) {
+            failed = true;
+            return "";
+        }
+        return names[n];
+    }
+
+    yyltype ReadLocation() {
+        yyltype loc;
+        memset(&loc, 0, sizeof(loc));
+        loc.first_line = ReadInt();
+        loc.first_column = ReadInt();
+        loc.last_line = ReadInt();
+        loc.last_column = ReadInt();
+        return loc;
+    }
+
+    Type *ReadBuiltin() {
+        static Type **builtins[] = {
+            &Type::intType, &Type::doubleType, &Type::boolType,
+            &Type::voidType, &Type::nullType, &Type::stringType,
+            &Type::errorType
+        };
+        const char *name = ReadName();
+        for (size_t i = 0; i < sizeof(builtins) / sizeof(*builtins); i++)
+            if (strcmp((*builtins[i])->Name(), name) == 0)
+                return *builtins[i];
+        failed = true;
+        return Type::errorType;
+    }
+
+    Node *ReadNode();
+    Expr *ReadCompound(astTagT tag);
+};
+
+Expr *AstReader::ReadCompound(astTagT tag) {
+    Expr *left = Read<Expr>();
+    Operator *op = Read<Operator>();
+    Expr *right = Read<Expr>();
+    if (failed || op == NULL || right == NULL) {
+        failed = true;
+        return NULL;
+    }
+
+    switch (tag) {
+      case ArithmeticExprTag:
+        return (left == NULL ? new ArithmeticExpr(op, right) :
+                new ArithmeticExpr(left, op, right));
+      case LogicalExprTag:
+        return (left == NULL ? new LogicalExpr(op, right) :
+                new LogicalExpr(left, op, right));
+      default:
+        break;
+    }
+    if (left == NULL) {
+        failed = true;
+        return NULL;
+    }
+    switch (tag) {
+      case RelationalExprTag: return new RelationalExpr(left, op, right);
+      case EqualityExprTag: return new EqualityExpr(left, op, right);
+      default: return new AssignExpr(left, op, right);
+    }
+}
+
+/* Function: ReadNode
+ * ------------------
+ * Reads one node and its children. Each case reads the fields in the
+ * order Save() wrote them, one statement at a time, since the order in
+ * which the arguments of a call are evaluated is unspecified.
+ */
+Node *AstReader::ReadNode() {
+    unsigned char tag = NullTag;
+    if (!Take(&tag, 1) || tag == NullTag)
+        return NULL;
+
+    yyltype loc;
+    switch (tag) {
+      case IdentifierTag: {
+        loc = ReadLocation();
+        return new Identifier(loc, ReadName());
+      }
+      case OperatorTag: {
+        loc = ReadLocation();
+        return new Operator(loc, ReadName());
+      }
+      case VarDeclTag: {
+        Identifier *id = Read<Identifier>();
+        Type *type = Read<Type>();
+        return (failed ? NULL : new VarDecl(id, type));
+      }
+      case ClassDeclTag: {
+        Identifier *id = Read<Identifier>();
+        NamedType *extends = Read<NamedType>();
+        List<NamedType*> *implements = ReadList<NamedType*>();
+        List<Decl*> *members = ReadList<Decl*>();
+        return (failed ? NULL :
+                new ClassDecl(id, extends, implements, members));
+      }
+      case InterfaceDeclTag: {
+        Identifier *id = Read<Identifier>();
+        List<Decl*> *members = ReadList<Decl*>();
+        return (failed ? NULL : new InterfaceDecl(id, members));
+      }
+      case FnDeclTag: {
+        Identifier *id = Read<Identifier>();
+        Type *returnType = Read<Type>();
+        List<VarDecl*> *formals = ReadList<VarDecl*>();
+        Stmt *body = Read<Stmt>();
+        if (failed)
+            return NULL;
+        FnDecl *fn = new FnDecl(id, returnType, formals);
+        if (body != NULL)
+            fn->SetFunctionBody(body);
+        return fn;
+      }
+      case BuiltinTypeTag:
+        return ReadBuiltin();
+      case NamedTypeTag: {
+        Identifier *id = Read<Identifier>();
+        return (failed ? NULL : new NamedType(id));
+      }
+      case ArrayTypeTag: {
+        loc = ReadLocation();
+        Type *elemType = Read<Type>();
+        return (failed ? NULL : new ArrayType(loc, elemType));
+      }
+      case StmtBlockTag: {
+        List<VarDecl*> *decls = ReadList<VarDecl*>();
+        List<Stmt*> *stmts = ReadList<Stmt*>();
+        return (failed ? NULL : new StmtBlock(decls, stmts));
+      }
+      case ForStmtTag: {
+        Expr *init = Read<Expr>();
+        Expr *test = Read<Expr>();
+        Expr *step = Read<Expr>();
+        Stmt *body = Read<Stmt>();
+        return (failed ? NULL : new ForStmt(init, test, step, body));
+      }
+      case WhileStmtTag: {
+        Expr *test = Read<Expr>();
+        Stmt *body = Read<Stmt>();
+        return (failed ? NULL : new WhileStmt(test, body));
+      }
+      case IfStmtTag: {
+        Expr *test = Read<Expr>();
+        Stmt *thenBody = Read<Stmt>();
+        Stmt *elseBody = Read<Stmt>();
+        return (failed ? NULL : new IfStmt(test, thenBody, elseBody));
+      }
+      case BreakStmtTag:
+        return new BreakStmt(ReadLocation());
+      case ReturnStmtTag: {
+        loc = ReadLocation();
+        Expr *expr = Read<Expr>();
+        return (failed ? NULL : new ReturnStmt(loc, expr));
+      }
+      case PrintStmtTag: {
+        List<Expr*> *args = ReadList<Expr*>();
+        return (failed ? NULL : new PrintStmt(args));
+      }
+      case EmptyExprTag:
+        return new EmptyExpr();
+      case IntConstantTag: {
+        loc = ReadLocation();
+        return new IntConstant(loc, ReadInt());
+      }
+      case DoubleConstantTag: {
+        loc = ReadLocation();
+        return new DoubleConstant(loc, ReadDouble());
+      }
+      case BoolConstantTag: {
+        loc = ReadLocation();
+        return new BoolConstant(loc, ReadInt() != 0);
+      }
+      case StringConstantTag: {
+        loc = ReadLocation();
+        return new StringConstant(loc, ReadName());
+      }
+      case NullConstantTag:
+        return new NullConstant(ReadLocation());
+      case ArithmeticExprTag:
+      case RelationalExprTag:
+      case EqualityExprTag:
+      case LogicalExprTag:
+      case AssignExprTag:
+        return ReadCompound((astTagT)tag);
+      case ThisTag:
+        return new This(ReadLocation());
+      case ArrayAccessTag: {
+        loc = ReadLocation();
+        Expr *base = Read<Expr>();
+        Expr *subscript = Read<Expr>();
+        return (failed ? NULL : new ArrayAccess(loc, base, subscript));
+      }
+      case FieldAccessTag: {
+        Expr *base = Read<Expr>();
+        Identifier *field = Read<Identifier>();
+        return (failed ? NULL : new FieldAccess(base, field));
+      }
+      case CallTag: {
+        loc = ReadLocation();
+        Expr *base = Read<Expr>();
+        Identifier *field = Read<Identifier>();
+        List<Expr*> *actuals = ReadList<Expr*>();
+        return (failed ? NULL : new Call(loc, base, field, actuals));
+      }
+      case NewExprTag: {
+        loc = ReadLocation();
+        NamedType *cType = Read<NamedType>();
+        return (failed ? NULL : new NewExpr(loc, cType));
+      }
+      case NewArrayExprTag: {
+        loc = ReadLocation();
+        Expr *size = Read<Expr>();
+        Type *elemType = Read<Type>();
+        return (failed ? NULL : new NewArrayExpr(loc, size, elemType));
+      }
+      case ReadIntegerExprTag:
+        return new ReadIntegerExpr(ReadLocation());
+      case ReadLineExprTag:
+        return new ReadLineExpr(ReadLocation());
+    }
+    failed = true;
+    return NULL;
+}
+
+
+// Returns the key of the source text, as compiled by this build of dcc
+// with the options that change what is parsed
+static string KeyOf(const char *text, size_t length) {
+    Sha256 hash;
+    string id = BuildId();
+    hash.Update(id.data(), id.size());
+    hash.Update(GetOption("signatures-only") ? "s" : "-", 1);
+    hash.Update(text, length);
+    return hash.HexDigest();
+}
+
+static string PathOf(const string &key) {
+    return string(GetOption("ast-cache")) + "/" + key + ".ast";
+}
+
+List<Decl*> *ReadAstFile(const string &path, const string &key,
+                         vector<size_t> *lines) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat s;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &s) == 0 && (size_t)s.st_size >= sizeof(AstHeader))
+        map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    const char *start = (const char *)map, *end = start + s.st_size;
+    AstHeader header;
+    memcpy(&header, start, sizeof(header));
+    const char *starts = start + sizeof(header);
+    const char *names = starts + (size_t)header.numLines * sizeof(uint32_t);
+    List<Decl*> *decls = NULL;
+    if (memcmp(header.magic, "dAST", sizeof(header.magic)) == 0 &&
+        header.version == AstVersion &&
+        memcmp(header.key, key.data(), sizeof(header.key)) == 0 &&
+        (uint64_t)header.numLines * sizeof(uint32_t) + header.namesSize +
+            header.nodesSize == (uint64_t)(end - starts)) {
+        // The fixups: each name is interned, and referred to by number
+        vector<const char*> fixups;
+        fixups.reserve(header.numNames);
+        const char *nodes = names + header.namesSize;
+        for (const char *p = names; p < nodes; ) {
+            const char *nul = (const char *)memchr(p, '\0', nodes - p);
+            if (nul == NULL)
+                break;
+            fixups.push_back(Intern(p, nul - p, HashName(p, nul - p)));
+            p = nul + 1;
+        }
+
+        AstReader reader(nodes, end, fixups);
+        if (fixups.size() == header.numNames) {
+            decls = reader.ReadList<Decl*>();
+            if (reader.Failed())
+                decls = NULL;
+        }
+        if (decls != NULL && lines != NULL) {
+            lines->resize(header.numLines);
+            for (uint32_t i = 0; i < header.numLines; i++) {
+                uint32_t start;
+                memcpy(&start, starts + i * sizeof(start), sizeof(start));
+                (*lines)[i] = start;
+            }
+        }
+    }
+    munmap(map, s.st_size);
+    return decls;
+}
+
+bool WriteAstFile(const string &path, const string &contents) {
+    size_t slash = path.rfind('/');
+    string temporary = (slash == string::npos ? string(".") :
+                        path.substr(0, slash)) + "/tmp.XXXXXX";
+    int fd = mkstemp(&temporary[0]);
+    if (fd < 0)
+        return false;
+    bool written = (write(fd, contents.data(), contents.size()) ==
+                    (ssize_t)contents.size());
+    fchmod(fd, 0666 & ~umask(umask(0)));
+    if (close(fd) != 0 || !written ||
+        rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool LoadCachedAst() {
+    loaded = false;
+    parsed = NULL;
+    key.clear();
+    if (GetOption("stream"))
+        return false;
+
+    key = KeyOf(GetSourceText(), GetSourceLength());
+    List<Decl*> *decls = ReadAstFile(PathOf(key), key, &lineStarts);
+    if (decls == NULL)
+        return false;
+    PrintDebug("ast-cache", "Loaded %s", PathOf(key).c_str());
+    loaded = true;
+    Program *program = new Program(decls);
+    program->Check();
+    return true;
+}
+
+void NoteParsedAst(List<Decl*> *decls) {
+    if (!loaded)
+        parsed = decls;
+}
+
+void SaveCachedAst() {
+    List<Decl*> *decls = parsed;
+    parsed = NULL;
+    if (decls == NULL || key.empty() || Program::NumParseErrors() > 0)
+        return;
+    string path = PathOf(key);
+    if (access(path.c_str(), F_OK) == 0 || GetSourceLength() > UINT32_MAX)
+        return;
+
+    AstWriter writer;
+    writer.WriteList(decls);
+    string contents = writer.Contents(key, lineStarts);
+
+    // Failing to save is no failure
+    mkdir(GetOption("ast-cache"), 0777);
+    if (WriteAstFile(path, contents))
+        PrintDebug("ast-cache", "Saved %s", path.c_str());
+}
@@ -0,0 +1,114 @@
+/* File: ast_cache.h
+ * -----------------
+ * The AST cache, for large sources that change rarely, like libraries.
+ * With --ast-cache=dir, the parse tree of a program that parses without
+ * errors is saved to dir in a compact binary form, under the SHA-256 of
+ * the source text, the build ID of dcc and whether --signatures-only was
+ * given. Compiling the same text again maps that file into memory and
+ * builds the tree straight from it, without running the scanner or the
+ * parser, then checks it as usual. The source is still read, to find
+ * the key and for the lines quoted with errors. Where those lines start
+ * is what the scanner would have recorded, so it is saved as well.
+ *
+ * The file holds a header, the offsets at which lines start, the table
+ * of names (identifiers and string constants, each NUL-terminated) and
+ * the nodes in preorder. A node is a tag, one of those below, followed
+ * by its fields in the order its constructor takes them: integers,
+ * locations, indices into the name table and child nodes, lists being a
+ * count and their elements. The only fixups are of names, which are
+ * interned once each. Files are written to a temporary name and renamed
+ * into place, so processes may share a directory; nothing is ever
+ * removed from it.
+ */
+
+#ifndef _H_ast_cache
+#define _H_ast_cache
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "list.h"
+#include "location.h"
+
+class Node;
+class Decl;
+
+typedef enum {
+    NullTag, IdentifierTag, OperatorTag,
+    VarDeclTag, ClassDeclTag, InterfaceDeclTag, FnDeclTag,
+    BuiltinTypeTag, NamedTypeTag, ArrayTypeTag,
+    StmtBlockTag, ForStmtTag, WhileStmtTag, IfStmtTag, BreakStmtTag,
+    ReturnStmtTag, PrintStmtTag,
+    EmptyExprTag, IntConstantTag, DoubleConstantTag, BoolConstantTag,
+    StringConstantTag, NullConstantTag, ArithmeticExprTag,
+    RelationalExprTag, EqualityExprTag, LogicalExprTag, AssignExprTag,
+    ThisTag, ArrayAccessTag, FieldAccessTag, CallTag, NewExprTag,
+    NewArrayExprTag, ReadIntegerExprTag, ReadLineExprTag,
+    NumAstTags
+} astTagT;
+
+/* Class: AstWriter
+ * ----------------
+ * Collects the serialized form of a tree. Each node class writes itself
+ * with Save(), using the methods here for its fields.
+ */
+class AstWriter
+{
+  public:
+    // Without bodies, functions are written as if they had none, for
+    // trees of declarations only (see module.h)
+    AstWriter(bool bodies = true) : bodies(bodies) {}
+
+    bool WritesBodies() { return bodies; }
+
+    void WriteTag(astTagT tag)  { nodes += (char)tag; }
+    void WriteInt(int32_t value);
+    void WriteDouble(double value);
+    void WriteName(const char *name);
+    void WriteLocation(yyltype *location);
+
+    // Writes node, or NullTag if it is NULL
+    void WriteNode(Node *node);
+
+    template<class Element> void WriteList(List<Element> *list) {
+        WriteInt(list->NumElements());
+        for (int i = 0, n = list->NumElements(); i < n; ++i)
+            WriteNode(list->Nth(i));
+    }
+
+    // Returns the file contents for the tree written, under key, with
+    // the offsets at which the lines of its source start
+    std::string Contents(const std::string &key,
+                         const std::vector<size_t> &lineStarts);
+
+  private:
+    bool bodies;
+    std::string names, nodes;
+    std::unordered_map<std::string, int32_t> numbers;   // of the names
+};
+
+// Returns the top-level declarations saved in the file at path, or NULL
+// if there is no such file or it does not hold a whole tree for key.
+// The offsets at which lines start go to lines, unless it is NULL.
+List<Decl*> *ReadAstFile(const std::string &path, const std::string &key,
+                         std::vector<size_t> *lines);
+
+// Writes contents to a temporary file next to path and renames it into
+// place, and returns whether that worked
+bool WriteAstFile(const std::string &path, const std::string &contents);
+
+// If there is a cached tree for the source opened by OpenSource(),
+// builds the program from it and checks it, and returns true
+bool LoadCachedAst();
+
+// Notes the top-level declarations of a program about to be checked.
+// The parser checks a program as soon as it has reduced it, which may
+// be before it finds a syntax error in what follows.
+void NoteParsedAst(List<Decl*> *decls);
+
+// Saves the tree noted, if the whole source parsed without errors and
+// the tree was not loaded from the cache
+void SaveCachedAst();
+
+#endif
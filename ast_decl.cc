@@ -5,6 +5,8 @@
 #include "ast_decl.h"
 #include "ast_type.h"
 #include "ast_stmt.h"
+#include "ast_cache.h"
+#include "xref.h"
 
 Decl::Decl(Identifier *n) : Node(*n->GetLocation()), scope(new Scope) {
     Assert(n != NULL);
@@ -36,6 +38,10 @@ bool VarDecl::IsEquivalentTo(Decl *other) {
 }
 
 void VarDecl::Check() {
+    if (writingXrefs) {
+        NoteDeclaration(this);
+        NoteTypeUse(type, scope);
+    }
     CheckType();
 }
 
@@ -46,7 +52,7 @@ void VarDecl::CheckType() {
     Scope *s = scope;
     while (s != NULL) {
         Decl *d;
-        if ((d = s->table->Lookup(type->Name())) != NULL) {
+        if ((d = s->Lookup(type->Name())) != NULL) {
             /* TODO: Do not let VarDecl's to be of an Interface type except
              * when in that Interfaces scope.
              */
@@ -62,6 +68,12 @@ void VarDecl::CheckType() {
     type->ReportNotDeclaredIdentifier(LookingForType);
 }
 
+void VarDecl::Save(AstWriter *out) {
+    out->WriteTag(VarDeclTag);
+    out->WriteNode(id);
+    out->WriteNode(type);
+}
+
 ClassDecl::ClassDecl(Identifier *n, NamedType *ex, List<NamedType*> *imp, List<Decl*> *m) : Decl(n) {
     // extends can be NULL, impl & mem may be empty lists but cannot be NULL
     Assert(n != NULL && imp != NULL && m != NULL);
@@ -69,6 +81,7 @@ ClassDecl::ClassDecl(Identifier *n, NamedType *ex, List<NamedType*> *imp, List<D
     if (extends) extends->SetParent(this);
     (implements=imp)->SetParentAll(this);
     (members=m)->SetParentAll(this);
+    type = new NamedType(n, false);
 }
 
 void ClassDecl::BuildScope(Scope *parent) {
@@ -86,6 +99,12 @@ void ClassDecl::Check() {
     for (int i = 0, n = members->NumElements(); i < n; ++i)
         members->Nth(i)->Check();
 
+    CheckInheritance();
+}
+
+void ClassDecl::CheckInheritance() {
+    if (writingXrefs)
+        NoteDeclaration(this);
     CheckExtends();
     CheckImplements();
 
@@ -100,9 +119,11 @@ void ClassDecl::CheckExtends() {
     if (extends == NULL)
         return;
 
-    Decl *lookup = scope->GetParent()->table->Lookup(extends->Name());
+    Decl *lookup = scope->GetParent()->Lookup(extends->Name());
     if (dynamic_cast<ClassDecl*>(lookup) == NULL)
         extends->ReportNotDeclaredIdentifier(LookingForClass);
+    else if (writingXrefs)
+        NoteUse(extends->GetId(), lookup);
 }
 
 void ClassDecl::CheckImplements() {
@@ -110,10 +131,12 @@ void ClassDecl::CheckImplements() {
 
     for (int i = 0, n = implements->NumElements(); i < n; ++i) {
         NamedType *nth = implements->Nth(i);
-        Decl *lookup = s->table->Lookup(implements->Nth(i)->Name());
+        Decl *lookup = s->Lookup(implements->Nth(i)->Name());
 
         if (dynamic_cast<InterfaceDecl*>(lookup) == NULL)
             nth->ReportNotDeclaredIdentifier(LookingForInterface);
+        else if (writingXrefs)
+            NoteUse(nth->GetId(), lookup);
     }
 }
 
@@ -121,7 +144,7 @@ void ClassDecl::CheckExtendedMembers(NamedType *extType) {
     if (extType == NULL)
         return;
 
-    Decl *lookup = scope->GetParent()->table->Lookup(extType->Name());
+    Decl *lookup = scope->GetParent()->Lookup(extType->Name());
     ClassDecl *extDecl = dynamic_cast<ClassDecl*>(lookup);
     if (extDecl == NULL)
         return;
@@ -131,7 +154,7 @@ void ClassDecl::CheckExtendedMembers(NamedType *extType) {
 }
 
 void ClassDecl::CheckImplementedMembers(NamedType *impType) {
-    Decl *lookup = scope->GetParent()->table->Lookup(impType->Name());
+    Decl *lookup = scope->GetParent()->Lookup(impType->Name());
     InterfaceDecl *intDecl = dynamic_cast<InterfaceDecl*>(lookup);
     if (intDecl == NULL)
         return;
@@ -143,7 +166,7 @@ void ClassDecl::CheckAgainstScope(Scope *other) {
     Iterator<Decl*> iter = scope->table->GetIterator();
     Decl *d;
     while ((d = iter.GetNextValue()) != NULL) {
-        Decl *lookup = other->table->Lookup(d->Name());
+        Decl *lookup = other->Lookup(d->Name());
 
         if (lookup == NULL)
             continue;
@@ -162,7 +185,7 @@ void ClassDecl::CheckImplementsInterfaces() {
 
     for (int i = 0, n = implements->NumElements(); i < n; ++i) {
         NamedType *nth = implements->Nth(i);
-        Decl *lookup = s->table->Lookup(implements->Nth(i)->Name());
+        Decl *lookup = s->Lookup(implements->Nth(i)->Name());
         InterfaceDecl *intDecl = dynamic_cast<InterfaceDecl*>(lookup);
 
         if (intDecl == NULL)
@@ -176,7 +199,7 @@ void ClassDecl::CheckImplementsInterfaces() {
             ClassDecl *classDecl = this;
             Decl *classLookup;
             while (classDecl != NULL) {
-                classLookup = classDecl->GetScope()->table->Lookup(d->Name());
+                classLookup = classDecl->GetScope()->Lookup(d->Name());
 
                 if (classLookup != NULL)
                     break;
@@ -185,7 +208,7 @@ void ClassDecl::CheckImplementsInterfaces() {
                     classDecl = NULL;
                 } else {
                     const char *extName = classDecl->GetExtends()->Name();
-                    Decl *ext = Program::gScope->table->Lookup(extName);
+                    Decl *ext = Program::gScope->Lookup(extName);
                     classDecl = dynamic_cast<ClassDecl*>(ext);
                 }
             }
@@ -198,9 +221,18 @@ void ClassDecl::CheckImplementsInterfaces() {
     }
 }
 
+void ClassDecl::Save(AstWriter *out) {
+    out->WriteTag(ClassDeclTag);
+    out->WriteNode(id);
+    out->WriteNode(extends);
+    out->WriteList(implements);
+    out->WriteList(members);
+}
+
 InterfaceDecl::InterfaceDecl(Identifier *n, List<Decl*> *m) : Decl(n) {
     Assert(n != NULL && m != NULL);
     (members=m)->SetParentAll(this);
+    type = new NamedType(n, false);
 }
 
 void InterfaceDecl::BuildScope(Scope *parent) {
@@ -214,10 +246,18 @@ void InterfaceDecl::BuildScope(Scope *parent) {
 }
 
 void InterfaceDecl::Check() {
+    if (writingXrefs)
+        NoteDeclaration(this);
     for (int i = 0, n = members->NumElements(); i < n; ++i)
         members->Nth(i)->Check();
 }
 
+void InterfaceDecl::Save(AstWriter *out) {
+    out->WriteTag(InterfaceDeclTag);
+    out->WriteNode(id);
+    out->WriteList(members);
+}
+
 FnDecl::FnDecl(Identifier *n, Type *r, List<VarDecl*> *d) : Decl(n) {
     Assert(n != NULL && r!= NULL && d != NULL);
     (returnType=r)->SetParent(this);
@@ -263,9 +303,21 @@ void FnDecl::BuildScope(Scope *parent) {
 }
 
 void FnDecl::Check() {
+    if (writingXrefs) {
+        NoteDeclaration(this);
+        NoteTypeUse(returnType, scope);
+    }
     for (int i = 0, n = formals->NumElements(); i < n; ++i)
         formals->Nth(i)->Check();
 
     if (body)
         body->Check();
 }
+
+void FnDecl::Save(AstWriter *out) {
+    out->WriteTag(FnDeclTag);
+    out->WriteNode(id);
+    out->WriteNode(returnType);
+    out->WriteList(formals);
+    out->WriteNode(out->WritesBodies() ? body : NULL);
+}
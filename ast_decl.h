@@ -38,6 +38,7 @@ class Decl : public Node
 
     const char* Name() { return id->Name(); }
     Scope* GetScope() { return scope; }
+    Decl* GetDecl() { return this; }
 
     virtual void BuildScope(Scope *parent);
     virtual void Check() = 0;
@@ -55,6 +56,7 @@ class VarDecl : public Decl
 
     Type* GetType() { return type; }
     void Check();
+    void Save(AstWriter *out);
 
   private:
     void CheckType();
@@ -66,6 +68,7 @@ class ClassDecl : public Decl
     List<Decl*> *members;
     NamedType *extends;
     List<NamedType*> *implements;
+    NamedType *type;
 
   public:
     ClassDecl(Identifier *name, NamedType *extends,
@@ -73,10 +76,16 @@ class ClassDecl : public Decl
 
     void BuildScope(Scope *parent);
     void Check();
+    void Save(AstWriter *out);
 
-    NamedType* GetType() { return new NamedType(id); }
+    // The part of Check() that concerns the class as a whole rather
+    // than each member: what it extends and implements, and overrides
+    void CheckInheritance();
+
+    NamedType* GetType() { return type; }
     NamedType* GetExtends() { return extends; }
     List<NamedType*>* GetImplements() { return implements; }
+    List<Decl*>* GetMembers() { return members; }
 
   private:
     void CheckExtends();
@@ -92,14 +101,16 @@ class InterfaceDecl : public Decl
 {
   protected:
     List<Decl*> *members;
+    NamedType *type;
 
   public:
     InterfaceDecl(Identifier *name, List<Decl*> *members);
 
     void BuildScope(Scope *parent);
     void Check();
+    void Save(AstWriter *out);
 
-    Type* GetType() { return new NamedType(id); }
+    Type* GetType() { return type; }
     List<Decl*>* GetMembers() { return members; }
 };
 
@@ -121,6 +132,7 @@ class FnDecl : public Decl
 
     void BuildScope(Scope *parent);
     void Check();
+    void Save(AstWriter *out);
 };
 
 #endif
@@ -7,6 +7,8 @@
 #include "ast_expr.h"
 #include "ast_type.h"
 #include "ast_decl.h"
+#include "ast_cache.h"
+#include "xref.h"
 
 ClassDecl* Expr::GetClassDecl(Scope *s) {
     while (s != NULL) {
@@ -23,7 +25,7 @@ Decl* Expr::GetFieldDecl(Identifier *f, Type *b) {
     NamedType *t = dynamic_cast<NamedType*>(b);
 
     while (t != NULL) {
-        Decl *d = Program::gScope->table->Lookup(t->Name());
+        Decl *d = Program::gScope->Lookup(t->Name());
         ClassDecl *c = dynamic_cast<ClassDecl*>(d);
         InterfaceDecl *i = dynamic_cast<InterfaceDecl*>(d);
 
@@ -46,10 +48,21 @@ Decl* Expr::GetFieldDecl(Identifier *f, Type *b) {
     return GetFieldDecl(f, scope);
 }
 
+Decl* Expr::GetFieldDecl(Expr *base, Identifier *f) {
+    if (base != NULL)
+        return GetFieldDecl(f, base->GetType());
+
+    ClassDecl *c = GetClassDecl(scope);
+    if (c == NULL)
+        return GetFieldDecl(f, scope);
+
+    return GetFieldDecl(f, c->GetType());
+}
+
 Decl* Expr::GetFieldDecl(Identifier *f, Scope *s) {
     while (s != NULL) {
         Decl *lookup;
-        if ((lookup = s->table->Lookup(f->Name())) != NULL)
+        if ((lookup = s->Lookup(f->Name())) != NULL)
             return lookup;
 
         s = s->GetParent();
@@ -62,10 +75,20 @@ Type* EmptyExpr::GetType() {
     return Type::errorType;
 }
 
+void EmptyExpr::Save(AstWriter *out) {
+    out->WriteTag(EmptyExprTag);
+}
+
 IntConstant::IntConstant(yyltype loc, int val) : Expr(loc) {
     value = val;
 }
 
+void IntConstant::Save(AstWriter *out) {
+    out->WriteTag(IntConstantTag);
+    out->WriteLocation(location);
+    out->WriteInt(value);
+}
+
 Type* IntConstant::GetType() {
     return Type::intType;
 }
@@ -74,6 +97,12 @@ DoubleConstant::DoubleConstant(yyltype loc, double val) : Expr(loc) {
     value = val;
 }
 
+void DoubleConstant::Save(AstWriter *out) {
+    out->WriteTag(DoubleConstantTag);
+    out->WriteLocation(location);
+    out->WriteDouble(value);
+}
+
 Type* DoubleConstant::GetType() {
     return Type::doubleType;
 }
@@ -82,6 +111,12 @@ BoolConstant::BoolConstant(yyltype loc, bool val) : Expr(loc) {
     value = val;
 }
 
+void BoolConstant::Save(AstWriter *out) {
+    out->WriteTag(BoolConstantTag);
+    out->WriteLocation(location);
+    out->WriteInt(value);
+}
+
 Type* BoolConstant::GetType() {
     return Type::boolType;
 }
@@ -91,6 +126,12 @@ StringConstant::StringConstant(yyltype loc, const char *val) : Expr(loc) {
     value = strdup(val);
 }
 
+void StringConstant::Save(AstWriter *out) {
+    out->WriteTag(StringConstantTag);
+    out->WriteLocation(location);
+    out->WriteName(value);
+}
+
 Type* StringConstant::GetType() {
     return Type::stringType;
 }
@@ -99,11 +140,22 @@ Type* NullConstant::GetType() {
     return Type::nullType;
 }
 
+void NullConstant::Save(AstWriter *out) {
+    out->WriteTag(NullConstantTag);
+    out->WriteLocation(location);
+}
+
 Operator::Operator(yyltype loc, const char *tok) : Node(loc) {
     Assert(tok != NULL);
     strncpy(tokenString, tok, sizeof(tokenString));
 }
 
+void Operator::Save(AstWriter *out) {
+    out->WriteTag(OperatorTag);
+    out->WriteLocation(location);
+    out->WriteName(tokenString);
+}
+
 CompoundExpr::CompoundExpr(Expr *l, Operator *o, Expr *r)
   : Expr(Join(l->GetLocation(), r->GetLocation())) {
     Assert(l != NULL && o != NULL && r != NULL);
@@ -136,6 +188,12 @@ void CompoundExpr::Check() {
     right->Check();
 }
 
+void CompoundExpr::SaveOperands(AstWriter *out) {
+    out->WriteNode(left);
+    out->WriteNode(op);
+    out->WriteNode(right);
+}
+
 Type* ArithmeticExpr::GetType() {
     Type *rtype = right->GetType();
 
@@ -191,6 +249,11 @@ void ArithmeticExpr::Check() {
     ReportError::IncompatibleOperands(op, ltype, rtype);
 }
 
+void ArithmeticExpr::Save(AstWriter *out) {
+    out->WriteTag(ArithmeticExprTag);
+    SaveOperands(out);
+}
+
 Type* RelationalExpr::GetType() {
     Type *rtype = right->GetType();
     Type *ltype = left->GetType();
@@ -221,6 +284,11 @@ void RelationalExpr::Check() {
     ReportError::IncompatibleOperands(op, ltype, rtype);
 }
 
+void RelationalExpr::Save(AstWriter *out) {
+    out->WriteTag(RelationalExprTag);
+    SaveOperands(out);
+}
+
 Type* EqualityExpr::GetType() {
     Type *rtype = right->GetType();
     Type *ltype = left->GetType();
@@ -244,6 +312,11 @@ void EqualityExpr::Check() {
         ReportError::IncompatibleOperands(op, ltype, rtype);
 }
 
+void EqualityExpr::Save(AstWriter *out) {
+    out->WriteTag(EqualityExprTag);
+    SaveOperands(out);
+}
+
 Type* LogicalExpr::GetType() {
     Type *rtype = right->GetType();
 
@@ -289,6 +362,11 @@ void LogicalExpr::Check() {
     ReportError::IncompatibleOperands(op, ltype, rtype);
 }
 
+void LogicalExpr::Save(AstWriter *out) {
+    out->WriteTag(LogicalExprTag);
+    SaveOperands(out);
+}
+
 Type* AssignExpr::GetType() {
     Type *ltype = left->GetType();
     Type *rtype = right->GetType();
@@ -310,6 +388,11 @@ void AssignExpr::Check() {
         ReportError::IncompatibleOperands(op, ltype, rtype);
 }
 
+void AssignExpr::Save(AstWriter *out) {
+    out->WriteTag(AssignExprTag);
+    SaveOperands(out);
+}
+
 Type* This::GetType() {
     ClassDecl *d = GetClassDecl(scope);
     if (d == NULL)
@@ -323,6 +406,11 @@ void This::Check() {
         ReportError::ThisOutsideClassScope(this);
 }
 
+void This::Save(AstWriter *out) {
+    out->WriteTag(ThisTag);
+    out->WriteLocation(location);
+}
+
 ArrayAccess::ArrayAccess(yyltype loc, Expr *b, Expr *s) : LValue(loc) {
     (base=b)->SetParent(this);
     (subscript=s)->SetParent(this);
@@ -355,6 +443,13 @@ void ArrayAccess::Check() {
         ReportError::SubscriptNotInteger(subscript);
 }
 
+void ArrayAccess::Save(AstWriter *out) {
+    out->WriteTag(ArrayAccessTag);
+    out->WriteLocation(location);
+    out->WriteNode(base);
+    out->WriteNode(subscript);
+}
+
 FieldAccess::FieldAccess(Expr *b, Identifier *f)
   : LValue(b? Join(b->GetLocation(), f->GetLocation()) : *f->GetLocation()) {
     Assert(f != NULL); // b can be be NULL (just means no explicit base)
@@ -364,31 +459,15 @@ FieldAccess::FieldAccess(Expr *b, Identifier *f)
 }
 
 Type* FieldAccess::GetType() {
-    Decl *d;
-    ClassDecl *c;
-    Type *t;
-
-    c = GetClassDecl(scope);
-
-    if (base == NULL) {
-        if (c == NULL) {
-            d = GetFieldDecl(field, scope);
-        } else {
-            t = c->GetType();
-            d = GetFieldDecl(field, t);
-        }
-    } else {
-        t = base->GetType();
-        d = GetFieldDecl(field, t);
-    }
-
+    VarDecl *d = dynamic_cast<VarDecl*>(GetDecl());
     if (d == NULL)
         return Type::errorType;
 
-    if (dynamic_cast<VarDecl*>(d) == NULL)
-        return Type::errorType;
+    return d->GetType();
+}
 
-    return static_cast<VarDecl*>(d)->GetType();
+Decl* FieldAccess::GetDecl() {
+    return GetFieldDecl(base, field);
 }
 
 void FieldAccess::BuildScope(Scope *parent) {
@@ -433,6 +512,14 @@ void FieldAccess::Check() {
 
     if (dynamic_cast<VarDecl*>(d) == NULL)
         ReportError::IdentifierNotDeclared(field, LookingForVariable);
+    else if (writingXrefs)
+        NoteUse(field, d);
+}
+
+void FieldAccess::Save(AstWriter *out) {
+    out->WriteTag(FieldAccessTag);
+    out->WriteNode(base);
+    out->WriteNode(field);
 }
 
 Call::Call(yyltype loc, Expr *b, Identifier *f, List<Expr*> *a) : Expr(loc)  {
@@ -473,6 +560,10 @@ Type* Call::GetType() {
     return static_cast<FnDecl*>(d)->GetReturnType();
 }
 
+Decl* Call::GetDecl() {
+    return GetFieldDecl(base, field);
+}
+
 void Call::BuildScope(Scope *parent) {
     scope->SetParent(parent);
 
@@ -519,6 +610,8 @@ void Call::Check() {
         }
     }
 
+    if (writingXrefs)
+        NoteUse(field, d);
     CheckActuals(d);
 }
 
@@ -547,14 +640,21 @@ void Call::CheckActuals(Decl *d) {
     }
 }
 
+void Call::Save(AstWriter *out) {
+    out->WriteTag(CallTag);
+    out->WriteLocation(location);
+    out->WriteNode(base);
+    out->WriteNode(field);
+    out->WriteList(actuals);
+}
+
 NewExpr::NewExpr(yyltype loc, NamedType *c) : Expr(loc) {
   Assert(c != NULL);
   (cType=c)->SetParent(this);
 }
 
 Type* NewExpr::GetType() {
-    Decl *d = Program::gScope->table->Lookup(cType->Name());
-    ClassDecl *c = dynamic_cast<ClassDecl*>(d);
+    ClassDecl *c = dynamic_cast<ClassDecl*>(GetDecl());
 
     if (c == NULL)
         return Type::errorType;
@@ -562,22 +662,30 @@ Type* NewExpr::GetType() {
     return c->GetType();
 }
 
+Decl* NewExpr::GetDecl() {
+    return Program::gScope->Lookup(cType->Name());
+}
+
 void NewExpr::Check() {
-    Decl *d = Program::gScope->table->Lookup(cType->Name());
-    ClassDecl *c = dynamic_cast<ClassDecl*>(d);
+    ClassDecl *c = dynamic_cast<ClassDecl*>(GetDecl());
 
     if (c == NULL)
         ReportError::IdentifierNotDeclared(cType->GetId(), LookingForClass);
+    else if (writingXrefs)
+        NoteUse(cType->GetId(), c);
+}
+
+void NewExpr::Save(AstWriter *out) {
+    out->WriteTag(NewExprTag);
+    out->WriteLocation(location);
+    out->WriteNode(cType);
 }
 
 NewArrayExpr::NewArrayExpr(yyltype loc, Expr *sz, Type *et) : Expr(loc) {
     Assert(sz != NULL && et != NULL);
     (size=sz)->SetParent(this);
     (elemType=et)->SetParent(this);
-}
-
-Type* NewArrayExpr::GetType() {
-    return new ArrayType(elemType);
+    type = new ArrayType(elemType);
 }
 
 void NewArrayExpr::BuildScope(Scope *parent) {
@@ -595,15 +703,34 @@ void NewArrayExpr::Check() {
     if (elemType->IsPrimitive() && !elemType->IsEquivalentTo(Type::voidType))
         return;
 
-    Decl *d = Program::gScope->table->Lookup(elemType->Name());
+    Decl *d = Program::gScope->Lookup(elemType->Name());
     if (dynamic_cast<ClassDecl*>(d) == NULL)
         elemType->ReportNotDeclaredIdentifier(LookingForType);
+    else if (writingXrefs)
+        NoteTypeUse(elemType, Program::gScope);
+}
+
+void NewArrayExpr::Save(AstWriter *out) {
+    out->WriteTag(NewArrayExprTag);
+    out->WriteLocation(location);
+    out->WriteNode(size);
+    out->WriteNode(elemType);
 }
 
 Type* ReadIntegerExpr::GetType() {
     return Type::intType;
 }
 
+void ReadIntegerExpr::Save(AstWriter *out) {
+    out->WriteTag(ReadIntegerExprTag);
+    out->WriteLocation(location);
+}
+
 Type* ReadLineExpr::GetType() {
     return Type::stringType;
 }
+
+void ReadLineExpr::Save(AstWriter *out) {
+    out->WriteTag(ReadLineExprTag);
+    out->WriteLocation(location);
+}
@@ -33,6 +33,10 @@ class Expr : public Stmt
     ClassDecl* GetClassDecl(Scope *s);
     Decl* GetFieldDecl(Identifier *field, Type *base);
     Decl* GetFieldDecl(Identifier *field, Scope *scope);
+
+    // Returns the declaration of field in base or, without one, in the
+    // enclosing class or scope
+    Decl* GetFieldDecl(Expr *base, Identifier *field);
 };
 
 /* This node type is used for those places where an expression is optional.
@@ -43,6 +47,7 @@ class EmptyExpr : public Expr
   public:
     Type* GetType();
     void Check() {}
+    void Save(AstWriter *out);
 };
 
 class IntConstant : public Expr
@@ -55,6 +60,7 @@ class IntConstant : public Expr
 
     Type* GetType();
     void Check() {}
+    void Save(AstWriter *out);
 };
 
 class DoubleConstant : public Expr
@@ -67,6 +73,7 @@ class DoubleConstant : public Expr
 
     Type* GetType();
     void Check() {}
+    void Save(AstWriter *out);
 };
 
 class BoolConstant : public Expr
@@ -79,6 +86,7 @@ class BoolConstant : public Expr
 
     Type* GetType();
     void Check() {}
+    void Save(AstWriter *out);
 };
 
 class StringConstant : public Expr
@@ -91,6 +99,7 @@ class StringConstant : public Expr
 
     Type* GetType();
     void Check() {}
+    void Save(AstWriter *out);
 };
 
 class NullConstant: public Expr
@@ -100,6 +109,7 @@ class NullConstant: public Expr
 
     Type* GetType();
     void Check() {}
+    void Save(AstWriter *out);
 };
 
 class Operator : public Node
@@ -110,6 +120,7 @@ class Operator : public Node
   public:
     Operator(yyltype loc, const char *tok);
     friend ostream& operator<<(ostream& out, Operator *o) { return out << o->tokenString; }
+    void Save(AstWriter *out);
  };
 
 class CompoundExpr : public Expr
@@ -124,6 +135,10 @@ class CompoundExpr : public Expr
 
     virtual void BuildScope(Scope *parent);
     virtual void Check();
+
+  protected:
+    // Writes the operands and operator, after the tag of the subclass
+    void SaveOperands(AstWriter *out);
 };
 
 class ArithmeticExpr : public CompoundExpr
@@ -134,6 +149,7 @@ class ArithmeticExpr : public CompoundExpr
 
     Type* GetType();
     void Check();
+    void Save(AstWriter *out);
 };
 
 class RelationalExpr : public CompoundExpr
@@ -143,6 +159,7 @@ class RelationalExpr : public CompoundExpr
 
     Type* GetType();
     void Check();
+    void Save(AstWriter *out);
 };
 
 class EqualityExpr : public CompoundExpr
@@ -153,6 +170,7 @@ class EqualityExpr : public CompoundExpr
 
     Type* GetType();
     void Check();
+    void Save(AstWriter *out);
 };
 
 class LogicalExpr : public CompoundExpr
@@ -164,6 +182,7 @@ class LogicalExpr : public CompoundExpr
 
     Type* GetType();
     void Check();
+    void Save(AstWriter *out);
 };
 
 class AssignExpr : public CompoundExpr
@@ -174,6 +193,7 @@ class AssignExpr : public CompoundExpr
 
     Type* GetType();
     void Check();
+    void Save(AstWriter *out);
 };
 
 class LValue : public Expr
@@ -189,6 +209,7 @@ class This : public Expr
 
     Type* GetType();
     void Check();
+    void Save(AstWriter *out);
 };
 
 class ArrayAccess : public LValue
@@ -202,6 +223,7 @@ class ArrayAccess : public LValue
     Type* GetType();
     void BuildScope(Scope *parent);
     void Check();
+    void Save(AstWriter *out);
 };
 
 /* Note that field access is used both for qualified names
@@ -219,8 +241,10 @@ class FieldAccess : public LValue
     FieldAccess(Expr *base, Identifier *field); //ok to pass NULL base
 
     Type* GetType();
+    Decl* GetDecl();
     void BuildScope(Scope *parent);
     void Check();
+    void Save(AstWriter *out);
 };
 
 /* Like field access, call is used both for qualified base.field()
@@ -238,8 +262,10 @@ class Call : public Expr
     Call(yyltype loc, Expr *base, Identifier *field, List<Expr*> *args);
 
     Type* GetType();
+    Decl* GetDecl();
     void BuildScope(Scope *parent);
     void Check();
+    void Save(AstWriter *out);
 
   private:
     void CheckActuals(Decl *d);
@@ -254,7 +280,9 @@ class NewExpr : public Expr
     NewExpr(yyltype loc, NamedType *clsType);
 
     Type* GetType();
+    Decl* GetDecl();
     void Check();
+    void Save(AstWriter *out);
 };
 
 class NewArrayExpr : public Expr
@@ -262,13 +290,15 @@ class NewArrayExpr : public Expr
   protected:
     Expr *size;
     Type *elemType;
+    ArrayType *type;
 
   public:
     NewArrayExpr(yyltype loc, Expr *sizeExpr, Type *elemType);
 
-    Type* GetType();
+    Type* GetType() { return type; }
     void BuildScope(Scope *parent);
     void Check();
+    void Save(AstWriter *out);
 };
 
 class ReadIntegerExpr : public Expr
@@ -278,6 +308,7 @@ class ReadIntegerExpr : public Expr
 
     Type* GetType();
     void Check() {}
+    void Save(AstWriter *out);
 };
 
 class ReadLineExpr : public Expr
@@ -287,6 +318,7 @@ class ReadLineExpr : public Expr
 
     Type* GetType();
     void Check() {}
+    void Save(AstWriter *out);
 };
 
 #endif
@@ -6,11 +6,18 @@
 #include "ast_type.h"
 #include "ast_decl.h"
 #include "ast_expr.h"
+#include "ast_cache.h"
 #include "errors.h"
+#include "utility.h" // for GetOption
 #include "ast_type.h"
+#include "dependencies.h"
+#include "imports.h"
+#include "incremental.h"
 
 int Scope::AddDecl(Decl *d) {
     Decl *lookup = table->Lookup(d->Name());
+    if (lookup == NULL && preloaded != NULL)
+        lookup = preloaded->Lookup(d->Name());
 
     if (lookup != NULL) {
             ReportError::DeclConflict(d, lookup);
@@ -21,6 +28,17 @@ int Scope::AddDecl(Decl *d) {
     return 0;
 }
 
+Decl* Scope::Lookup(const char *name) {
+    Decl *d = table->Lookup(name);
+    if (d == NULL && preloaded != NULL)
+        d = preloaded->Lookup(name);
+
+    if (globalLookups != NULL && this == Program::gScope)
+        globalLookups->push_back(make_pair(name, d));
+
+    return d;
+}
+
 ostream& operator<<(ostream& out, Scope *s) {
     out << "========== Scope ==========" << std::endl;
     Iterator<Decl*> iter = s->table->GetIterator();
@@ -30,7 +48,27 @@ ostream& operator<<(ostream& out, Scope *s) {
     return out;
 }
 
-Scope *Program::gScope = new Scope();
+vector<pair<const char*, Decl*> > *Scope::globalLookups = NULL;
+
+thread_local Scope *Program::gScope = new Scope();
+int Program::numDeclared = 0;
+int Program::numSemanticErrors = 0;
+List<Decl*> *Program::preloaded = new List<Decl*>;
+List<Decl*> *Program::checked = NULL;
+
+// The declarations preloaded last and a table of them, which the global
+// scope looks in after its own while they are preloaded
+static List<Decl*> *tabled = NULL;
+static Hashtable<Decl*> *preloadedTable = NULL;
+
+/* The errors found ahead of the checks are ordered as if they had been
+ * found by BuildScope() below: first those from entering each global
+ * declaration, then those from building each one's scope, then the ones
+ * from the checks.
+ */
+static const orderKeyT EarlyKeys = (orderKeyT)1 << 62;
+static const orderKeyT ScopeKeys = EarlyKeys + ((orderKeyT)1 << 40);
+static const orderKeyT CheckKeys = EarlyKeys + ((orderKeyT)2 << 40);
 
 Program::Program(List<Decl*> *d) {
     Assert(d != NULL);
@@ -46,20 +84,105 @@ void Program::Check() {
      *      and polymorphism in the node classes.
      */
 
+    if (DeferCheck(decls))
+        return;
+    DependencyGraph::Clear();
+    if (GetOption("ast-cache"))
+        NoteParsedAst(decls);
+
+    int numErrors = ReportError::NumErrors();
+    if (numDeclared > 0)
+        Diagnostics::SetOrderKey(CheckKeys);
+    checked = decls;
+
     BuildScope();
 
-    for (int i = 0, n = decls->NumElements(); i < n; ++i)
-        decls->Nth(i)->Check();
+    if ((GetOption("incremental") || GetOption("invalidates")) &&
+        numDeclared == 0)
+        CheckUnits(decls);
+    else
+        for (int i = 0, n = decls->NumElements(); i < n; ++i)
+            decls->Nth(i)->Check();
+
+    if (GetOption("invalidates"))
+        DependencyGraph::PrintInvalidated(GetOption("invalidates"));
+
+    numSemanticErrors += ReportError::NumErrors() - numErrors;
 }
 
 void Program::BuildScope() {
-    for (int i = 0, n = decls->NumElements(); i < n; ++i)
+    for (int i = numDeclared, n = decls->NumElements(); i < n; ++i)
         gScope->AddDecl(decls->Nth(i));
 
-    for (int i = 0, n = decls->NumElements(); i < n; ++i)
+    for (int i = numDeclared, n = decls->NumElements(); i < n; ++i)
         decls->Nth(i)->BuildScope(gScope);
 }
 
+void Program::Declare(Decl *decl) {
+    // --invalidates needs the whole program, to split its checks into
+    // units (see dependencies.h), so it waits for Check()
+    if (!GetOption("stream") || NumParseErrors() > 0 || HasImports() ||
+        GetOption("invalidates"))
+        return;
+
+    PrintDebug("stream", "Declaring %s", decl->Name());
+    int numErrors = ReportError::NumErrors();
+    orderKeyT key = Diagnostics::GetOrderKey();
+    Diagnostics::SetOrderKey(EarlyKeys + numDeclared);
+    gScope->AddDecl(decl);
+    Diagnostics::SetOrderKey(ScopeKeys + numDeclared);
+    decl->BuildScope(gScope);
+    Diagnostics::SetOrderKey(key);
+
+    numDeclared++;
+    numSemanticErrors += ReportError::NumErrors() - numErrors;
+}
+
+void Program::Preload(List<Decl*> *d) {
+    Assert(preloaded->NumElements() == 0 && gScope->preloaded == NULL);
+    if (d != tabled) {
+        preloadedTable = new Hashtable<Decl*>;
+        for (int i = 0, n = d->NumElements(); i < n; ++i)
+            preloadedTable->Enter(d->Nth(i)->Name(), d->Nth(i));
+        tabled = d;
+    }
+    gScope->preloaded = preloadedTable;
+    preloaded = d;
+}
+
+List<Decl*> *Program::Declarations() {
+    if (checked == NULL)
+        return NULL;
+    List<Decl*> *all = new List<Decl*>;
+    for (int i = 0, n = preloaded->NumElements(); i < n; ++i)
+        all->Append(preloaded->Nth(i));
+    for (int i = 0, n = checked->NumElements(); i < n; ++i)
+        all->Append(checked->Nth(i));
+    return all;
+}
+
+void Program::NoteChecked(List<Decl*> *d, int numErrors) {
+    checked = d;
+    numSemanticErrors += numErrors;
+}
+
+int Program::NumParseErrors() {
+    return ReportError::NumErrors() - numSemanticErrors;
+}
+
+void Program::Reset() {
+    gScope->table = new Hashtable<Decl*>;
+    gScope->preloaded = NULL;
+    preloaded = new List<Decl*>;
+    checked = NULL;
+    numDeclared = numSemanticErrors = 0;
+}
+
+void Program::DiscardEarlyErrors() {
+    Diagnostics::DiscardFrom(EarlyKeys);
+    numSemanticErrors = 0;
+}
+
 void Stmt::BuildScope(Scope *parent) {
     scope->SetParent(parent);
 }
@@ -91,6 +214,12 @@ void StmtBlock::Check() {
         stmts->Nth(i)->Check();
 }
 
+void StmtBlock::Save(AstWriter *out) {
+    out->WriteTag(StmtBlockTag);
+    out->WriteList(decls);
+    out->WriteList(stmts);
+}
+
 ConditionalStmt::ConditionalStmt(Expr *t, Stmt *b) {
     Assert(t != NULL && b != NULL);
     (test=t)->SetParent(this);
@@ -126,6 +255,20 @@ ForStmt::ForStmt(Expr *i, Expr *t, Expr *s, Stmt *b): LoopStmt(t, b) {
     (step=s)->SetParent(this);
 }
 
+void ForStmt::Save(AstWriter *out) {
+    out->WriteTag(ForStmtTag);
+    out->WriteNode(init);
+    out->WriteNode(test);
+    out->WriteNode(step);
+    out->WriteNode(body);
+}
+
+void WhileStmt::Save(AstWriter *out) {
+    out->WriteTag(WhileStmtTag);
+    out->WriteNode(test);
+    out->WriteNode(body);
+}
+
 IfStmt::IfStmt(Expr *t, Stmt *tb, Stmt *eb): ConditionalStmt(t, tb) {
     Assert(t != NULL && tb != NULL); // else can be NULL
     elseBody = eb;
@@ -153,6 +296,13 @@ void IfStmt::Check() {
         elseBody->Check();
 }
 
+void IfStmt::Save(AstWriter *out) {
+    out->WriteTag(IfStmtTag);
+    out->WriteNode(test);
+    out->WriteNode(body);
+    out->WriteNode(elseBody);
+}
+
 void BreakStmt::Check() {
     Scope *s = scope;
     while (s != NULL) {
@@ -165,6 +315,11 @@ void BreakStmt::Check() {
     ReportError::BreakOutsideLoop(this);
 }
 
+void BreakStmt::Save(AstWriter *out) {
+    out->WriteTag(BreakStmtTag);
+    out->WriteLocation(location);
+}
+
 ReturnStmt::ReturnStmt(yyltype loc, Expr *e) : Stmt(loc) {
     Assert(e != NULL);
     (expr=e)->SetParent(this);
@@ -201,6 +356,12 @@ void ReturnStmt::Check() {
         ReportError::ReturnMismatch(this, given, expected);
 }
 
+void ReturnStmt::Save(AstWriter *out) {
+    out->WriteTag(ReturnStmtTag);
+    out->WriteLocation(location);
+    out->WriteNode(expr);
+}
+
 PrintStmt::PrintStmt(List<Expr*> *a) {
     Assert(a != NULL);
     (args=a)->SetParentAll(this);
@@ -226,3 +387,8 @@ void PrintStmt::Check() {
     for (int i = 0, n = args->NumElements(); i < n; ++i)
         args->Nth(i)->Check();
 }
+
+void PrintStmt::Save(AstWriter *out) {
+    out->WriteTag(PrintStmtTag);
+    out->WriteList(args);
+}
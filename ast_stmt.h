@@ -12,6 +12,8 @@
 #ifndef _H_ast_stmt
 #define _H_ast_stmt
 
+#include <utility>
+#include <vector>
 #include "list.h"
 #include "ast.h"
 #include "hashtable.h"
@@ -32,13 +34,14 @@ class Scope
 
   public:
     Hashtable<Decl*> *table;
+    Hashtable<Decl*> *preloaded;    // looked in after table, or NULL
     ClassDecl *classDecl;
     LoopStmt *loopStmt;
     FnDecl *fnDecl;
 
   public:
-    Scope() : table(new Hashtable<Decl*>), classDecl(NULL), loopStmt(NULL),
-              fnDecl(NULL) {}
+    Scope() : parent(NULL), table(new Hashtable<Decl*>), preloaded(NULL),
+              classDecl(NULL), loopStmt(NULL), fnDecl(NULL) {}
 
     void SetParent(Scope *p) { parent = p; }
     Scope* GetParent() { return parent; }
@@ -53,21 +56,72 @@ class Scope
     FnDecl* GetFnDecl() { return fnDecl; }
 
     int AddDecl(Decl *decl);
+
+    // Returns the declaration of name in this scope, not looking in its
+    // parents, or NULL
+    Decl* Lookup(const char *name);
+
+    // While set, each lookup in the global scope is appended to it along
+    // with what it found, to tell what a check depends on (see
+    // incremental.h)
+    static vector<pair<const char*, Decl*> > *globalLookups;
+
     friend ostream& operator<<(ostream& out, Scope *s);
 };
 
 class Program : public Node
 {
   public:
-     static Scope *gScope;
+     // Each thread has its own, for the files of a program that are
+     // checked at the same time, in their own scopes (see imports.h)
+     static thread_local Scope *gScope;
 
   protected:
      List<Decl*> *decls;
+     static int numDeclared, numSemanticErrors;
+     static List<Decl*> *preloaded, *checked;
 
   public:
      Program(List<Decl*> *declList);
      void Check();
 
+     // When streaming (--stream), enters each top-level declaration into
+     // the global scope and builds its scope as soon as it is parsed,
+     // which leaves only the checks for the end. Does nothing otherwise.
+     static void Declare(Decl *decl);
+
+     // Enters declarations that have been checked already, those of a
+     // module (see module.h), into the global scope ahead of the
+     // program's own. Their scopes must have been built, in the global
+     // scope; they are not checked again. The table they are entered in
+     // is kept for the next time the same ones are preloaded.
+     static void Preload(List<Decl*> *decls);
+
+     static List<Decl*> *Preloaded() { return preloaded; }
+
+     // Returns the preloaded declarations followed by those of the
+     // program checked last, or NULL if none has been.
+     static List<Decl*> *Declarations();
+
+     // Notes the declarations of a program of several files, which are
+     // checked file by file instead of by Check() (see imports.h), and
+     // the number of errors found in them
+     static void NoteChecked(List<Decl*> *decls, int numErrors);
+
+     // Returns the number of errors reported so far by the scanner and
+     // parser, as opposed to those found by semantic analysis.
+     static int NumParseErrors();
+
+     // Drops the errors found by Declare, for when the parse failed.
+     static void DiscardEarlyErrors();
+
+     // Starts over with an empty global scope, to compile another
+     // program in the same process. Nothing stays preloaded. The scope
+     // is the same one, emptied, so the scopes of declarations built in
+     // it before, as preloaded ones are, need no change to be used in
+     // it again; after a fork, they are not so much as written to.
+     static void Reset();
+
   private:
      void BuildScope();
 };
@@ -96,6 +150,7 @@ class StmtBlock : public Stmt
 
     void BuildScope(Scope *parent);
     void Check();
+    void Save(AstWriter *out);
 
   private:
 };
@@ -129,12 +184,16 @@ class ForStmt : public LoopStmt
 
   public:
     ForStmt(Expr *init, Expr *test, Expr *step, Stmt *body);
+
+    void Save(AstWriter *out);
 };
 
 class WhileStmt : public LoopStmt
 {
   public:
     WhileStmt(Expr *test, Stmt *body) : LoopStmt(test, body) {}
+
+    void Save(AstWriter *out);
 };
 
 class IfStmt : public ConditionalStmt
@@ -147,6 +206,7 @@ class IfStmt : public ConditionalStmt
 
     void BuildScope(Scope *parent);
     void Check();
+    void Save(AstWriter *out);
 };
 
 class BreakStmt : public Stmt
@@ -155,6 +215,7 @@ class BreakStmt : public Stmt
     BreakStmt(yyltype loc) : Stmt(loc) {}
 
     void Check();
+    void Save(AstWriter *out);
 };
 
 class ReturnStmt : public Stmt
@@ -167,6 +228,7 @@ class ReturnStmt : public Stmt
 
     void BuildScope(Scope *parent);
     void Check();
+    void Save(AstWriter *out);
 };
 
 class PrintStmt : public Stmt
@@ -179,6 +241,7 @@ class PrintStmt : public Stmt
 
     void BuildScope(Scope *parent);
     void Check();
+    void Save(AstWriter *out);
 };
 
 #endif
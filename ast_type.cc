@@ -6,6 +6,7 @@
 #include <string.h>
 #include "ast_type.h"
 #include "ast_decl.h"
+#include "ast_cache.h"
 
 /* Class constants
  * ---------------
@@ -38,9 +39,16 @@ bool Type::IsEquivalentTo(Type *other) {
     return IsEqualTo(other);
 }
 
-NamedType::NamedType(Identifier *i) : Type(*i->GetLocation()) {
+void Type::Save(AstWriter *out) {
+    out->WriteTag(BuiltinTypeTag);
+    out->WriteName(typeName);
+}
+
+NamedType::NamedType(Identifier *i, bool adopt) : Type(*i->GetLocation()) {
     Assert(i != NULL);
-    (id=i)->SetParent(this);
+    id = i;
+    if (adopt)
+        id->SetParent(this);
 }
 
 void NamedType::ReportNotDeclaredIdentifier(reasonT reason) {
@@ -62,7 +70,7 @@ bool NamedType::IsEquivalentTo(Type *other) {
 
     NamedType *nType = this;
     Decl *lookup;
-    while ((lookup = Program::gScope->table->Lookup(nType->Name())) != NULL) {
+    while ((lookup = Program::gScope->Lookup(nType->Name())) != NULL) {
         ClassDecl *c = dynamic_cast<ClassDecl*>(lookup);
         if (c == NULL)
             return false;
@@ -84,6 +92,15 @@ bool NamedType::IsEquivalentTo(Type *other) {
     return false;
 }
 
+Decl* NamedType::GetDecl() {
+    return Program::gScope->Lookup(Name());
+}
+
+void NamedType::Save(AstWriter *out) {
+    out->WriteTag(NamedTypeTag);
+    out->WriteNode(id);
+}
+
 ArrayType::ArrayType(yyltype loc, Type *et) : Type(loc) {
     Assert(et != NULL);
     (elemType=et)->SetParent(this);
@@ -91,7 +108,7 @@ ArrayType::ArrayType(yyltype loc, Type *et) : Type(loc) {
 
 ArrayType::ArrayType(Type *et) : Type() {
     Assert(et != NULL);
-    (elemType=et)->SetParent(this);
+    elemType = et;
 }
 
 void ArrayType::ReportNotDeclaredIdentifier(reasonT reason) {
@@ -115,3 +132,9 @@ bool ArrayType::IsEquivalentTo(Type *other) {
 
     return elemType->IsEquivalentTo(arrayOther->elemType);
 }
+
+void ArrayType::Save(AstWriter *out) {
+    out->WriteTag(ArrayTypeTag);
+    out->WriteLocation(location);
+    out->WriteNode(elemType);
+}
@@ -39,6 +39,7 @@ class Type : public Node
 
     virtual const char* Name() { return typeName; }
     virtual bool IsPrimitive() { return true; }
+    virtual void Save(AstWriter *out);
 };
 
 class NamedType : public Type
@@ -47,7 +48,9 @@ class NamedType : public Type
     Identifier *id;
 
   public:
-    NamedType(Identifier *i);
+    // Unless adopt is false, i becomes the type's child; a type that only
+    // borrows i leaves it where it is (see ClassDecl::GetType)
+    NamedType(Identifier *i, bool adopt = true);
 
     void PrintToStream(ostream& out) { out << id; }
     void ReportNotDeclaredIdentifier(reasonT reason);
@@ -57,6 +60,8 @@ class NamedType : public Type
     const char* Name() { return id->Name(); }
     bool IsPrimitive() { return false; }
     Identifier* GetId() { return id; }
+    Decl* GetDecl();
+    void Save(AstWriter *out);
 };
 
 class ArrayType : public Type
@@ -66,6 +71,8 @@ class ArrayType : public Type
 
   public:
     ArrayType(yyltype loc, Type *elemType);
+    // An array of elemType that only borrows it, for the type of an
+    // expression that has elemType as a child (see NewArrayExpr)
     ArrayType(Type *elemType);
 
     void PrintToStream(ostream& out) { out << elemType << "[]"; }
@@ -77,6 +84,7 @@ class ArrayType : public Type
     bool IsPrimitive() { return false; }
 
     Type* GetElemType() { return elemType; }
+    void Save(AstWriter *out);
 };
 
 #endif
@@ -0,0 +1,594 @@
+#! /bin/sh
+
+# Throughput benchmarks for dcc. Each benchmark generates a large Decaf
+# input, runs dcc over it in the modes being compared and reports the
+# best of $RUNS runs in MB/s of Decaf source.
+#
+# Usage: ./bench.sh [benchmark] [size-in-MB]
+#
+#   pipeline   interleaved vs. pipelined (--pipeline) scanning and parsing
+#   chunked    sequential vs. chunked (--chunked) scanning on 1 to 8 threads
+#   comments   flex vs. fast scanner (--fast-scan) on comment-heavy source
+#   identifiers
+#              flex vs. fast scanner on identifier-heavy source
+#   numbers    flex vs. fast scanner on matrix initializers, which are
+#              mostly numeric literals
+#   longblock  a single function whose body is one long block of
+#              statements, about 1.2 million of them at the default size;
+#              fails unless dcc accepts it
+#   parser     bison vs. hand-written (--rd-parse) parser on many small
+#              functions, one long block and the samples repeated, with
+#              peak memory when GNU time is installed as /usr/bin/time
+#   signatures full check vs. --signatures-only on a library of classes
+#              and interfaces with fair-sized method bodies
+#   errors     source with two or three errors per line of code, written
+#              out in full and with --max-errors=100
+#   server     latency of a cold dcc run vs. a compile request to a
+#              resident server (--serve, --client) on one of the samples,
+#              one request at a time and from 8 clients at once; the
+#              size is ignored and $REQUESTS requests are timed
+#   incremental
+#              full check vs. --incremental by a compile server of the
+#              signatures library, unchanged and with one method edited
+#   watch      re-check times reported by dcc --watch for the signatures
+#              library, checked in full and then with one method edited
+#              and changed back, each $RUNS times; the library is one
+#              file, so there are no importers to check again with it
+#   cache      full check vs. a hit in the result cache (--cache) for the
+#              signatures library
+#   astcache   fresh parse vs. loading the tree from the AST cache
+#              (--ast-cache) for many small functions, which check
+#              quickly, with the size of the cache file
+#   module     full check of a small program pasted after the signatures
+#              library vs. the program alone with the library preloaded
+#              from a precompiled module (--module), with the size of the
+#              module file
+#   zygote     latency of a cold dcc run vs. a worker pool (--serve) vs.
+#              a fork per request (--serve --zygote), each checking the
+#              program of the module benchmark against the library
+#              module, one request at a time and from 8 clients at once;
+#              the size is that of the library, and $REQUESTS requests
+#              are timed
+#   imports    full check of the module benchmark's program pasted after
+#              the signatures library vs. the program importing the
+#              library split into $FILES files that do not import one
+#              another, checked on one thread and on one per processor
+#   positions  full check of the signatures library vs. the same check
+#              answering $QUERIES position queries (--at) spread over it
+#   xref       full check of the signatures library vs. the same check
+#              writing the cross-reference index (--xref), with the size
+#              of the index
+#   keywords   flex DFA size (flex -v) and throughput with the keyword
+#              table vs. one flex rule per keyword, rebuilt in $TMP
+
+[ -x dcc ] || { echo "Error: dcc not executable"; exit 1; }
+
+BENCH=${1:-"pipeline"}
+MB=${2:-"16"}
+RUNS=${RUNS:-"3"}
+tmp=${TMP:-"/tmp"}
+DCC=./dcc
+
+# gen_functions <MB> <file>
+# Writes a program of many small functions. A stray character at the end
+# keeps dcc from running the semantic checks, so only scanning and
+# parsing are timed.
+gen_functions() {
+	awk -v limit=$(($1 * 1048576)) 'BEGIN {
+		for (i = 0; size < limit; i++) {
+			s = sprintf("int f%d(int a, double b) {\n" \
+			    "    int x;\n    bool done;\n" \
+			    "    x = a * %d + 3;\n" \
+			    "    // keep going until the counter catches up\n" \
+			    "    while (x < 100) { x = x + a %% 7; }\n" \
+			    "    if (x == %d) { Print(\"hit\", x); } else { done = true; }\n" \
+			    "    return x;\n}\n\n", i, i, i)
+			printf "%s", s
+			size += length(s)
+		}
+		print "@"
+	}' > $2
+}
+
+# gen_comments <MB> <file>
+# Writes a program that is mostly block and // comments.
+gen_comments() {
+	awk -v limit=$(($1 * 1048576)) 'BEGIN {
+		for (i = 0; size < limit; i++) {
+			s = sprintf("/* Function: f%d\n" \
+			    " * ------------------------------------------------" \
+			    "----------------------\n" \
+			    " * Computes nothing in particular, at some length, " \
+			    "so that there is\n * a fair amount of text to skip " \
+			    "over before the code starts. */\n" \
+			    "int f%d(int a) {\n" \
+			    "    // the result is the argument, unchanged, as " \
+			    "it has always been\n" \
+			    "    return a;   /* see above */\n}\n\n", i, i)
+			printf "%s", s
+			size += length(s)
+		}
+		print "@"
+	}' > $2
+}
+
+# gen_identifiers <MB> <file>
+# Writes a program whose statements are dominated by long identifiers.
+gen_identifiers() {
+	awk -v limit=$(($1 * 1048576)) 'BEGIN {
+		for (i = 0; size < limit; i++) {
+			s = sprintf("void update%d(int currentIndexValue, " \
+			    "int previousIndexValue) {\n" \
+			    "    int accumulatedTotalSoFar;\n" \
+			    "    accumulatedTotalSoFar = currentIndexValue + " \
+			    "previousIndexValue * currentIndexValue;\n" \
+			    "    runningTotalForUpdate%d = accumulatedTotalSoFar " \
+			    "- previousIndexValue;\n}\n\n", i, i)
+			printf "%s", s
+			size += length(s)
+		}
+		print "@"
+	}' > $2
+}
+
+# gen_numbers <MB> <file>
+# Writes a program of functions that fill in 8x8 matrices element by
+# element, with a mix of integer, hexadecimal and double literals.
+gen_numbers() {
+	awk -v limit=$(($1 * 1048576)) 'BEGIN {
+		srand(1)
+		for (i = 0; size < limit; i++) {
+			s = sprintf("void init%d(double[][] m, int[][] n) {\n", i)
+			for (r = 0; r < 8; r++) {
+				for (c = 0; c < 8; c++) {
+					v = rand() * 2000 - 1000
+					s = s sprintf("    m[%d][%d] = %.10e;\n", r, c, v)
+					s = s sprintf("    n[%d][%d] = %d + 0x%X;\n",
+					    r, c, v * 1000, rand() * 65536)
+				}
+			}
+			s = s "}\n\n"
+			printf "%s", s
+			size += length(s)
+		}
+		print "@"
+	}' > $2
+}
+
+# gen_long_block <MB> <file>
+# Writes a program whose main function is one block of short statements.
+gen_long_block() {
+	awk -v limit=$(($1 * 1048576)) 'BEGIN {
+		print "void main() {\n    int x;\n    int y;"
+		for (i = 0; size < limit; i++) {
+			s = sprintf(i % 2 ? "    x = x + %d;\n" : "    y = x;\n",
+			    i % 10)
+			printf "%s", s
+			size += length(s)
+		}
+		print "}"
+	}' > $2
+}
+
+# gen_library <MB> <file>
+# Writes a library of classes in short hierarchies, each class
+# implementing an interface, whose methods have a few statements each.
+# It is free of errors, so dcc checks all of it.
+gen_library() {
+	awk -v limit=$(($1 * 1048576)) 'BEGIN {
+		for (i = 0; size < limit; i++) {
+			ext = (i % 4 ? sprintf("extends Poly%d ", i - 1) : "")
+			fields = (i % 4 ? "" : "    int n;\n    double w;\n")
+			s = sprintf("interface Shape%d {\n" \
+			    "    double Area(double scale);\n    int Sides();\n}\n\n" \
+			    "class Poly%d %simplements Shape%d {\n%s",
+			    i, i, ext, i, fields)
+			s = s "    double Area(double scale) {\n" \
+			    "        double a;\n        int k;\n" \
+			    "        a = w * w * scale;\n" \
+			    "        for (k = 0; k < n; k = k + 1) {\n" \
+			    "            if (k % 2 == 0) a = a + w; else a = a - w;\n" \
+			    "        }\n        return a;\n    }\n" \
+			    "    int Sides() {\n" \
+			    "        while (n < 3) { n = n + 1; }\n" \
+			    "        Print(\"sides: \", n);\n        return n;\n" \
+			    "    }\n}\n\n"
+			printf "%s", s
+			size += length(s)
+		}
+	}' > $2
+}
+
+# gen_errors <MB> <file>
+# Writes functions full of undeclared names and mismatched operands, for
+# a negative test that produces hundreds of thousands of errors.
+gen_errors() {
+	awk -v limit=$(($1 * 1048576)) 'BEGIN {
+		for (i = 0; size < limit; i++) {
+			s = sprintf("void f%d() {\n    int x;\n" \
+			    "    x = y%d + true;\n    z%d = \"s\" * x;\n}\n\n",
+			    i, i, i)
+			printf "%s", s
+			size += length(s)
+		}
+	}' > $2
+}
+
+# gen_samples <MB> <file>
+# Writes the samples that parse without syntax errors over and over. The
+# result is full of conflicting declarations, so like the others it ends
+# in a stray character to skip the semantic checks.
+gen_samples() {
+	files=`grep -L "syntax error" samples/*.out | sed 's/\.out$/.decaf/'`
+	: > $2
+	while [ `wc -c < $2` -lt $(($1 * 1048576)) ]; do
+		cat $files >> $2
+	done
+	echo "@" >> $2
+}
+
+# keyword_rules
+# Prints the flex rules that matched keywords before they were looked up
+# in the keyword table.
+keyword_rules() {
+	for kw in void:Void int:Int double:Double bool:Bool string:String \
+	    null:Null class:Class extends:Extends this:This \
+	    interface:Interface implements:Implements while:While for:For \
+	    if:If else:Else return:Return break:Break new:New \
+	    NewArray:NewArray Print:Print ReadInteger:ReadInteger \
+	    ReadLine:ReadLine; do
+		echo "\"${kw%%:*}\" { return T_${kw#*:}; }"
+	done
+	printf '"true"|"false" { yylval.boolConstant = (yytext[0] == \047t\047);'
+	printf ' return T_BoolConstant; }\n'
+}
+
+# dfa_stats <scanner.l>
+dfa_stats() {
+	flex -v -t $1 2>&1 >/dev/null | grep -E "DFA states|table entries"
+}
+
+# best_time <input> <dcc args...>
+# Prints the best wall-clock time in seconds over $RUNS runs. If $before
+# is set, each run is preceded by an untimed one over that file.
+best_time() {
+	input=$1; shift
+	best=
+	i=0
+	while [ $i -lt $RUNS ]; do
+		[ -n "$before" ] && $DCC "$@" < $before >/dev/null 2>&1
+		start=`date +%s.%N`
+		$DCC "$@" < $input >/dev/null 2>&1
+		end=`date +%s.%N`
+		best=`echo $start $end $best | awk '{ t = $2 - $1;
+			if ($3 == "" || t < $3) print t; else print $3 }'`
+		i=$(($i + 1))
+	done
+	echo $best
+}
+
+# report <label> <input> <dcc args...>
+report() {
+	label=$1; input=$2; shift 2
+	secs=`best_time $input "$@"`
+	bytes=`wc -c < $input`
+	echo $label $bytes $secs | awk '{ printf "%-28s: %8.3f s %10.1f MB/s\n",
+		$1, $3, $2 / 1048576 / $3 }'
+}
+
+# start_server <dcc args...>
+# Starts a compile server on $socket in the background.
+start_server() {
+	socket=$tmp/bench-dcc.sock
+	$DCC --serve=$socket "$@" &
+	server=$!
+	while [ ! -S $socket ]; do
+		sleep 0.1
+	done
+}
+
+stop_server() {
+	kill $server
+	wait $server
+}
+
+# report_latency <label> <clients> <input> <dcc args...>
+# Prints the mean time per compile of $REQUESTS compiles of a small input,
+# spread over the given number of clients running at once.
+report_latency() {
+	label=$1; clients=$2; input=$3; shift 3
+	start=`date +%s.%N`
+	pids=
+	c=0
+	while [ $c -lt $clients ]; do
+		i=$c
+		while [ $i -lt $REQUESTS ]; do
+			$DCC "$@" < $input >/dev/null 2>&1
+			i=$(($i + $clients))
+		done &
+		pids="$pids $!"
+		c=$(($c + 1))
+	done
+	wait $pids
+	end=`date +%s.%N`
+	echo $label $start $end $REQUESTS | awk '{
+		printf "%-28s: %8.3f ms per compile\n", $1,
+		    ($3 - $2) * 1000 / $4 }'
+}
+
+# report_memory <label> <input> <dcc args...>
+# Prints the peak resident set size of one run, if GNU time is there.
+report_memory() {
+	label=$1; input=$2; shift 2
+	[ -x /usr/bin/time ] || return 0
+	kb=`/usr/bin/time -f %M $DCC "$@" < $input 2>&1 >/dev/null | tail -1`
+	echo $label $kb | awk '{ printf "%-28s: %8.1f MB peak\n", $1, $2 / 1024 }'
+}
+
+case $BENCH in
+pipeline)
+	input=$tmp/bench-functions.decaf
+	gen_functions $MB $input
+	report interleaved $input
+	report pipelined $input --pipeline
+	;;
+chunked)
+	input=$tmp/bench-functions.decaf
+	gen_functions $MB $input
+	report sequential $input
+	for n in 1 2 4 8; do
+		report chunked-$n $input --chunked --scan-threads=$n
+	done
+	;;
+comments|identifiers|numbers)
+	input=$tmp/bench-$BENCH.decaf
+	gen_$BENCH $MB $input
+	report flex $input
+	for isa in scalar sse2 avx2; do
+		report fast-$isa $input --fast-scan=$isa
+	done
+	;;
+longblock)
+	input=$tmp/bench-longblock.decaf
+	gen_long_block $MB $input
+	$DCC < $input >/dev/null 2>&1 || {
+		echo "Error: dcc cannot compile a long block"; exit 1; }
+	report long-block $input
+	;;
+parser)
+	for gen in functions long_block samples; do
+		input=$tmp/bench-parser-$gen.decaf
+		gen_$gen $MB $input
+		report bison-$gen $input
+		report rd-$gen $input --rd-parse
+		report_memory bison-$gen $input
+		report_memory rd-$gen $input --rd-parse
+	done
+	;;
+signatures)
+	input=$tmp/bench-library.decaf
+	gen_library $MB $input
+	report full-check $input
+	report signatures-only $input --signatures-only
+	;;
+errors)
+	input=$tmp/bench-errors.decaf
+	gen_errors $MB $input
+	report all-errors $input
+	report max-errors-100 $input --max-errors=100
+	;;
+server)
+	REQUESTS=${REQUESTS:-"500"}
+	input=samples/bad4.decaf
+	start_server --workers=8
+	report_latency cold-1 1 $input
+	report_latency client-1 1 $input --client=$socket
+	report_latency cold-8 8 $input
+	report_latency client-8 8 $input --client=$socket
+	stop_server
+	;;
+incremental)
+	input=$tmp/bench-library.decaf
+	edited=$tmp/bench-library-edited.decaf
+	gen_library $MB $input
+	awk -v half=$((`wc -l < $input` / 2)) '
+		NR > half && !done && sub(/w \* w \*/, "w *") { done = 1 } 1' \
+	    $input > $edited
+	start_server --workers=1
+	report full-check $edited --client=$socket
+	report unchanged $edited --client=$socket --incremental
+	before=$input
+	report one-edit $edited --client=$socket --incremental
+	before=
+	stop_server
+	;;
+watch)
+	dir=$tmp/bench-watch
+	log=$tmp/bench-watch.log
+	input=$tmp/bench-library.decaf
+	edited=$tmp/bench-library-edited.decaf
+	rm -rf $dir && mkdir $dir || exit 1
+	gen_library $MB $input
+	awk -v half=$((`wc -l < $input` / 2)) '
+		NR > half && !done && sub(/w \* w \*/, "w *") { done = 1 } 1' \
+	    $input > $edited
+	cp $input $dir/library.decaf
+	$DCC --watch $dir > $log &
+	watcher=$!
+	checks=1
+	i=0
+	while [ $i -le $RUNS ]; do
+		until [ `grep -c "checked in" $log` -ge $checks ]; do
+			sleep 0.01
+		done
+		[ $i -eq $RUNS ] && break
+		for f in $edited $input; do
+			cp $f $dir/.next && mv $dir/.next $dir/library.decaf
+			checks=$(($checks + 1))
+			until [ `grep -c "checked in" $log` -ge $checks ]; do
+				sleep 0.01
+			done
+		done
+		i=$(($i + 1))
+	done
+	kill $watcher
+	wait $watcher
+	awk '/checked in/ {
+		label = (n == 0 ? "full-check" : n % 2 ? "one-edit" : "undo-edit")
+		if (!(label in best) || $(NF - 1) < best[label])
+			best[label] = $(NF - 1)
+		n++
+	    } END {
+		split("full-check one-edit undo-edit", labels)
+		for (i = 1; i <= 3; i++)
+			printf "%-28s: %8.3f ms per re-check\n", labels[i],
+			    best[labels[i]]
+	    }' $log
+	;;
+cache)
+	dir=$tmp/bench-cache
+	input=$tmp/bench-library.decaf
+	rm -rf $dir
+	gen_library $MB $input
+	report full-check $input
+	before=$input
+	report cache-hit $input --cache=$dir
+	before=
+	rm -rf $dir
+	;;
+astcache)
+	dir=$tmp/bench-ast-cache
+	input=$tmp/bench-ast-cache.decaf
+	rm -rf $dir
+	gen_functions $MB $input
+	sed -i '$d' $input      # no stray character: the tree must be checked
+	report fresh-parse $input
+	before=$input
+	report ast-cache-load $input --ast-cache=$dir
+	before=
+	ls -l $dir/*.ast | awk '{
+		printf "%-28s: %8.1f MB\n", "cache-file", $5 / 1048576 }'
+	rm -rf $dir
+	;;
+module|zygote)
+	library=$tmp/bench-library.decaf
+	module=$tmp/bench-library.dcm
+	program=$tmp/bench-module-program.decaf
+	input=$tmp/bench-module-concatenated.decaf
+	gen_library $MB $library
+	cat > $program <<-EOF
+	void main() {
+	    Poly2 p;
+	    Shape1 s;
+	    double a;
+	    p = new Poly2;
+	    s = new Poly1;
+	    a = p.Area(2.0) + s.Area(0.5);
+	    Print(p.Sides() + s.Sides());
+	}
+	EOF
+	cat $library $program > $input
+	$DCC --emit-module=$module < $library || exit 1
+	if [ $BENCH = module ]; then
+		report concatenated $input
+		report preloaded $program --module=$module
+		ls -l $module | awk '{
+			printf "%-28s: %8.1f MB\n", "module-file", $5 / 1048576 }'
+	else
+		REQUESTS=${REQUESTS:-"200"}
+		report_latency cold-1 1 $program --module=$module
+		report_latency cold-8 8 $program --module=$module
+		for mode in pool zygote; do
+			if [ $mode = pool ]; then
+				start_server --workers=8 --module=$module
+			else
+				start_server --workers=8 --module=$module --zygote
+			fi
+			report_latency $mode-1 1 $program --client=$socket
+			report_latency $mode-8 8 $program --client=$socket
+			stop_server
+		done
+	fi
+	rm -f $module
+	;;
+imports)
+	library=$tmp/bench-library.decaf
+	dir=$tmp/bench-imports
+	program=$tmp/bench-imports-program.decaf
+	input=$tmp/bench-imports-concatenated.decaf
+	FILES=${FILES:-"16"}
+	rm -rf $dir && mkdir $dir || exit 1
+	gen_library $MB $library
+	# Poly4k to Poly4k+3 extend one another; each group goes whole
+	# into one of the files
+	awk -v dir=$dir -v files=$FILES '/^interface Shape[0-9]+ / {
+		i = substr($2, 6)
+		if (i % 4 == 0)
+			part = sprintf("%s/part%d.decaf", dir, i / 4 % files)
+	} { print > part }' $library
+	for part in $dir/*.decaf; do
+		echo "import \"$part\";"
+	done > $program
+	cat >> $program <<-EOF
+	void main() {
+	    Poly2 p;
+	    Shape1 s;
+	    double a;
+	    p = new Poly2;
+	    s = new Poly1;
+	    a = p.Area(2.0) + s.Area(0.5);
+	    Print(p.Sides() + s.Sides());
+	}
+	EOF
+	{ cat $library; grep -v '^import' $program; } > $input
+	report concatenated $input
+	report imports-1-thread $program --check-threads=1
+	report imports $program
+	rm -rf $dir
+	;;
+positions)
+	input=$tmp/bench-library.decaf
+	QUERIES=${QUERIES:-"1000"}
+	gen_library $MB $input
+	# The last name on evenly spaced lines that have one
+	at=`awk -v queries=$QUERIES -v name='[A-Za-z_][A-Za-z0-9_]*' '
+	    NR == FNR { n++; next }
+	    FNR >= next_line && match($0, name "[^A-Za-z0-9_]*$") {
+		printf "%s%d:%d", sep, FNR, RSTART; sep = ","
+		next_line = FNR + n / queries
+	    }' $input $input`
+	report check $input
+	report positions $input --at=$at
+	;;
+xref)
+	input=$tmp/bench-library.decaf
+	index=$tmp/bench-xref.txt
+	gen_library $MB $input
+	report check $input
+	report xref $input --xref=$index
+	echo "index: `wc -l < $index` lines, `wc -c < $index` bytes"
+	rm -f $index
+	;;
+keywords)
+	rules=$tmp/dcc-keyword-rules
+	rm -rf $rules && mkdir $rules || exit 1
+	cp *.cc *.h *.l *.y Makefile $rules || exit 1
+	keyword_rules > $rules/keywords.l
+	awk 'NR == FNR { rules = rules $0 "\n"; next }
+	    index($0, "{IDENTIFIER}") == 1 { printf "%s", rules } { print }' \
+	    $rules/keywords.l scanner.l > $rules/scanner.l
+	(cd $rules && make -s dcc >/dev/null 2>&1) || {
+		echo "Error: cannot build dcc with keyword rules"; exit 1; }
+	echo "keyword table:"; dfa_stats scanner.l
+	echo "keyword rules:"; dfa_stats $rules/scanner.l
+	input=$tmp/bench-identifiers.decaf
+	gen_identifiers $MB $input
+	report keyword-table $input
+	DCC=$rules/dcc
+	report keyword-rules $input
+	;;
+*)
+	echo "Error: unknown benchmark: $BENCH"
+	exit 1
+	;;
+esac
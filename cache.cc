@@ -0,0 +1,348 @@
+/* File: cache.cc
+ * --------------
+ * Implementation of the result cache. An entry lives at dir/xx/yyyy...,
+ * where xx are the first two hex digits of its key and yyyy... the
+ * rest, and holds a header, the exit status and the length of the error
+ * output, followed by the output itself. Hits and misses are counted by
+ * appending a byte to dir/hits or dir/misses, which is atomic, so the
+ * counts are the sizes of those files, until they are halved.
+ */
+
+#include "cache.h"
+#include <dirent.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "diagnostics.h"
+#include "errors.h"
+#include "imports.h"
+#include "module.h"
+#include "sha256.h"
+#include "source.h"
+#include "utility.h"
+using namespace std;
+
+int Compile();                  // Defined in main.cc
+
+static const char Magic[4] = { 'd', 'c', 'c', 1 };
+static const int HeaderSize = sizeof(Magic) + 2 * sizeof(int32_t);
+static const long DefaultSize = 256;        // megabytes
+static const double Trimmed = 0.9;          // of the limit, after eviction
+static const int StaleTemporary = 3600;     // seconds
+static const off_t MaxCount = 1 << 20;      // hits or misses, see Count
+
+
+const char *CacheDirectory() {
+    const char *dir = GetOption("cache");
+    if (dir == NULL || *dir == '\0')
+        dir = getenv("DCC_CACHE");
+    return (dir != NULL && *dir != '\0' ? dir : NULL);
+}
+
+static bool IsCacheOption(const char *arg) {
+    static const char *names[] = { "--cache", "--cache-size" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        size_t n = strlen(names[i]);
+        if (strncmp(arg, names[i], n) == 0 &&
+            (arg[n] == '\0' || arg[n] == '='))
+            return true;
+    }
+    return false;
+}
+
+static bool Cacheable(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "-d") == 0)
+            return false;
+    return (!GetOption("invalidates") && !GetOption("stream") &&
+            !GetOption("emit-module") && !GetOption("at") &&
+            !GetOption("xref"));
+}
+
+static int AddBuildId(struct dl_phdr_info *info, size_t size, void *data) {
+    for (int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) &segment = info->dlpi_phdr[i];
+        if (segment.p_type != PT_NOTE)
+            continue;
+        const char *p = (const char *)(info->dlpi_addr + segment.p_vaddr);
+        const char *end = p + segment.p_memsz;
+        while (p + sizeof(ElfW(Nhdr)) <= end) {
+            const ElfW(Nhdr) *note = (const ElfW(Nhdr) *)p;
+            const char *name = p + sizeof(ElfW(Nhdr));
+            const char *desc = name + ((note->n_namesz + 3) & ~3);
+            if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 &&
+                memcmp(name, "GNU", 4) == 0) {
+                ((string *)data)->assign(desc, note->n_descsz);
+                return 1;
+            }
+            p = desc + ((note->n_descsz + 3) & ~3);
+        }
+    }
+    return 1;                   // the first object is dcc, the rest libraries
+}
+
+string BuildId() {
+    string id;
+    dl_iterate_phdr(AddBuildId, &id);
+    struct stat exe;
+    if (id.empty() && stat("/proc/self/exe", &exe) == 0) {
+        id.append((const char *)&exe.st_size, sizeof(exe.st_size));
+        id.append((const char *)&exe.st_mtime, sizeof(exe.st_mtime));
+    }
+    return id;
+}
+
+// Returns the key of the compile asked for by the command line
+static string Key(int argc, char *argv[]) {
+    Sha256 hash;
+    string id = BuildId();
+    hash.Update(id.data(), id.size());
+    hash.Update("", 1);
+
+    for (int i = 1; i < argc; i++)
+        if (argv[i] != GetInputFile() && !IsCacheOption(argv[i]))
+            hash.Update(argv[i], strlen(argv[i]) + 1);
+    hash.Update("", 1);
+    string module = ModuleDigest();
+    hash.Update(module.data(), module.size());
+    hash.Update(GetSourceText(), GetSourceLength());
+    return hash.HexDigest();
+}
+
+static string EntryPath(const char *dir, const string &key) {
+    return string(dir) + "/" + key.substr(0, 2) + "/" + key.substr(2);
+}
+
+/* Function: Count
+ * ---------------
+ * Counts a hit or a miss. So that the files do not grow forever, once
+ * either passes MaxCount both are cut to half their size, which keeps
+ * the rate of hits but weighs recent compiles more than old ones. A
+ * count appended by another process meanwhile may be lost, which is no
+ * matter for statistics.
+ */
+static void Count(const char *dir, const char *counter) {
+    string path = string(dir) + "/" + counter;
+    int fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0666);
+    if (fd < 0)
+        return;
+    struct stat s;
+    bool full = (write(fd, "+", 1) == 1 && fstat(fd, &s) == 0 &&
+                 s.st_size > MaxCount);
+    close(fd);
+    if (!full)
+        return;
+    static const char *counters[] = { "hits", "misses" };
+    for (int i = 0; i < 2; i++) {
+        path = string(dir) + "/" + counters[i];
+        if (stat(path.c_str(), &s) == 0)
+            truncate(path.c_str(), s.st_size / 2);
+    }
+}
+
+static long Counted(const char *dir, const char *counter) {
+    struct stat s;
+    string path = string(dir) + "/" + counter;
+    return (stat(path.c_str(), &s) == 0 ? (long)s.st_size : 0);
+}
+
+// Reads an entry and marks it used, see Evict, and sets touched to
+// whether that worked: only the owner of a file, or one who may write it,
+// can set its time
+static bool ReadEntry(const string &path, string &errors, int &status,
+                      bool &touched) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat s;
+    char header[HeaderSize];
+    bool found = (fstat(fd, &s) == 0 && s.st_size >= HeaderSize &&
+                  read(fd, header, HeaderSize) == HeaderSize &&
+                  memcmp(header, Magic, sizeof(Magic)) == 0);
+    if (found) {
+        int32_t fields[2];
+        memcpy(fields, header + sizeof(Magic), sizeof(fields));
+        status = fields[0];
+        errors.resize(s.st_size - HeaderSize);
+        found = (fields[1] == (int32_t)errors.size() &&
+                 (errors.empty() ||
+                  read(fd, &errors[0], errors.size()) ==
+                  (ssize_t)errors.size()));
+    }
+    touched = (found && futimens(fd, NULL) == 0);
+    close(fd);
+    return found;
+}
+
+struct Entry
+{
+    string path;
+    time_t used;
+    off_t size;
+
+    bool operator<(const Entry &other) const { return used < other.used; }
+};
+
+// Lists the entries of the cache, oldest first, and removes temporary
+// files left behind by processes that died writing them
+static void ListEntries(const char *dir, vector<Entry> &entries) {
+    time_t now = time(NULL);
+    for (int i = 0; i < 256; i++) {
+        char sub[3];
+        snprintf(sub, sizeof(sub), "%02x", i);
+        string path = string(dir) + "/" + sub;
+        DIR *d = opendir(path.c_str());
+        if (d == NULL)
+            continue;
+        for (struct dirent *e; (e = readdir(d)) != NULL; ) {
+            Entry entry;
+            entry.path = path + "/" + e->d_name;
+            struct stat s;
+            if (e->d_name[0] == '.' ||
+                stat(entry.path.c_str(), &s) != 0 || !S_ISREG(s.st_mode))
+                continue;
+            if (strncmp(e->d_name, "tmp.", 4) == 0) {
+                if (now - s.st_mtime > StaleTemporary)
+                    unlink(entry.path.c_str());
+                continue;
+            }
+            entry.used = s.st_mtime;
+            entry.size = s.st_size;
+            entries.push_back(entry);
+        }
+        closedir(d);
+    }
+    sort(entries.begin(), entries.end());
+}
+
+static long Limit() {
+    const char *size = GetOption("cache-size");
+    return (size != NULL && atol(size) > 0 ? atol(size) : DefaultSize) << 20;
+}
+
+/* Function: Evict
+ * ---------------
+ * Removes the least recently used entries until the cache is back under
+ * its limit, with some room to spare. Listing the cache costs more than
+ * a hit, so only about one store in sixteen, chosen by key, looks; the
+ * cache may outgrow its limit by the entries stored in between.
+ */
+static void Evict(const char *dir) {
+    vector<Entry> entries;
+    ListEntries(dir, entries);
+    long total = 0, limit = Limit();
+    for (size_t i = 0; i < entries.size(); i++)
+        total += entries[i].size;
+    if (total <= limit)
+        return;
+    for (size_t i = 0; i < entries.size() && total > limit * Trimmed; i++)
+        if (unlink(entries[i].path.c_str()) == 0)
+            total -= entries[i].size;
+}
+
+// Stores an entry, if the cache directory can be written; a compile
+// need not fail for want of a cache
+static bool StoreEntry(const char *dir, const string &key,
+                       const string &errors, int status) {
+    string path = EntryPath(dir, key);
+    string sub = path.substr(0, path.rfind('/'));
+    mkdir(dir, 0777);
+    mkdir(sub.c_str(), 0777);
+
+    string temporary = sub + "/tmp.XXXXXX";
+    int fd = mkstemp(&temporary[0]);
+    if (fd < 0)
+        return false;
+    int32_t fields[2] = { status, (int32_t)errors.size() };
+    string entry(Magic, sizeof(Magic));
+    entry.append((const char *)fields, sizeof(fields));
+    entry += errors;
+    bool written = (write(fd, entry.data(), entry.size()) ==
+                    (ssize_t)entry.size());
+    fchmod(fd, 0666 & ~umask(umask(0)));
+    if (close(fd) != 0 || !written ||
+        rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+static void WriteEntry(const char *dir, const string &key,
+                       const string &errors, int status) {
+    if (StoreEntry(dir, key, errors, status) && key[2] == '0')
+        Evict(dir);
+}
+
+static void WriteErrors(const string &errors) {
+    const char *p = errors.data();
+    for (size_t n = errors.size(); n > 0; ) {
+        ssize_t put = write(STDERR_FILENO, p, n);
+        if (put < 0 && errno == EINTR)
+            continue;
+        if (put < 0)
+            break;
+        p += put;
+        n -= put;
+    }
+}
+
+int CompileCached(int argc, char *argv[]) {
+    const char *dir = CacheDirectory();
+    if (!Cacheable(argc, argv)) {
+        int status = Compile();
+        ReportError::Flush();
+        return status;
+    }
+
+    string key = Key(argc, argv), errors;
+    int status;
+    bool touched;
+    if (ReadEntry(EntryPath(dir, key), errors, status, touched)) {
+        if (!touched)           // another's entry: store it again as ours
+            StoreEntry(dir, key, errors, status);
+        Count(dir, "hits");
+        WriteErrors(errors);
+        return status;
+    }
+
+    status = Compile();
+    Diagnostics::Render(errors);
+    if (!HasImports())          // the key does not cover the other files
+        WriteEntry(dir, key, errors, status);
+    Count(dir, "misses");
+    WriteErrors(errors);
+    return status;
+}
+
+int PrintCacheStats() {
+    const char *dir = CacheDirectory();
+    if (dir == NULL)
+        Failure("No cache directory; use --cache=dir or DCC_CACHE");
+    vector<Entry> entries;
+    ListEntries(dir, entries);
+    long total = 0;
+    for (size_t i = 0; i < entries.size(); i++)
+        total += entries[i].size;
+    long hits = Counted(dir, "hits"), misses = Counted(dir, "misses");
+
+    printf("Cache %s:\n", dir);
+    printf("    %ld entries, %.1f MB of %.1f MB\n", (long)entries.size(),
+           total / 1048576.0, Limit() / 1048576.0);
+    printf("    %ld hits, %ld misses", hits, misses);
+    if (hits + misses > 0)
+        printf(" (%.1f%% hits)", 100.0 * hits / (hits + misses));
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,47 @@
+/* File: cache.h
+ * -------------
+ * The result cache, for callers like CI jobs that compile the same files
+ * over and over. With --cache=dir, or DCC_CACHE=dir in the environment,
+ * dcc looks the compile up in dir before doing it and records its result
+ * afterwards: the exact error output and the exit status. The key is
+ * the SHA-256 of the build ID of dcc itself, the command line less the
+ * file name and these options, the module preloaded if any (see
+ * module.h) and the source text, so a repeated compile costs hashing the
+ * source and reading one file, and a new build of dcc never sees the
+ * results of an old one.
+ *
+ * Several dcc processes may share a directory. An entry is written to a
+ * temporary file and renamed into place, so it is seen whole or not at
+ * all. The directory is kept under --cache-size=MB (default 256) by
+ * evicting the least recently used entries; a hit counts as a use, and
+ * a hit on an entry another user stored, whose time cannot be set, stores
+ * it again. Hits and misses are counted in the directory as well, both
+ * halved once either passes about a million, and --cache-stats prints
+ * the counts and the size of the cache instead of compiling.
+ *
+ * Compiles that write to standard output as well, with debugging flags,
+ * --invalidates or --at, those that stream their source and those that emit
+ * a module or a cross-reference index are not cached.
+ */
+
+#ifndef _H_cache
+#define _H_cache
+
+#include <string>
+
+// Returns the build ID of dcc, for keys that must change with it. A dcc
+// linked without one is told apart from others by the size and
+// modification time of its executable instead.
+std::string BuildId();
+
+// Returns the cache directory, or NULL if there is no cache
+const char *CacheDirectory();
+
+// Compiles the source opened by OpenSource(), or writes out the errors
+// of the same compile from the cache, and returns the exit status
+int CompileCached(int argc, char *argv[]);
+
+// Prints the statistics of the cache and returns the exit status
+int PrintCacheStats();
+
+#endif
@@ -28,7 +28,11 @@ for file in $LIST; do
 	fi
 
 	tmp=${TMP:-"/tmp"}/check.tmp
-	./dcc < $base.$ext 1>$tmp 2>&1
+	if [ -r $base.args ]; then
+		./dcc `cat $base.args` $base.$ext 1>$tmp 2>&1
+	else
+		./dcc < $base.$ext 1>$tmp 2>&1
+	fi
 
 	printf "Checking %-27s: " $file
 	if ! cmp -s $tmp $file; then
@@ -0,0 +1,85 @@
+/* File: dependencies.cc
+ * ---------------------
+ * Implementation of the dependency graph. Edges are kept both ways: out
+ * of each unit, and for each name, the units with an edge to it.
+ */
+
+#include "dependencies.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include "ast_decl.h"
+#include "intern.h"
+
+static vector<DependencyNode> units;
+static unordered_map<const char*, vector<int> > dependents;
+
+
+void DependencyGraph::Clear() {
+    units.clear();
+    dependents.clear();
+}
+
+int DependencyGraph::AddUnit(Decl *decl, bool inheritance) {
+    units.push_back(DependencyNode());
+    units.back().decl = decl;
+    units.back().inheritance = inheritance;
+    return units.size() - 1;
+}
+
+void DependencyGraph::AddDependency(int unit, const char *name) {
+    units[unit].dependencies.push_back(name);
+    dependents[name].push_back(unit);
+}
+
+const vector<DependencyNode>& DependencyGraph::Units() {
+    return units;
+}
+
+// Returns the top-level declaration a unit is part of
+static Decl *TopLevel(const DependencyNode &unit) {
+    ClassDecl *c = dynamic_cast<ClassDecl*>(unit.decl->GetParent());
+    return (c != NULL ? c : unit.decl);
+}
+
+vector<int> DependencyGraph::Invalidated(const char *name) {
+    name = Intern(name, strlen(name), HashName(name, strlen(name)));
+
+    vector<int> result;
+    for (size_t i = 0; i < units.size(); i++)
+        if (TopLevel(units[i])->Name() == name)
+            result.push_back(i);
+
+    unordered_map<const char*, vector<int> >::iterator d =
+        dependents.find(name);
+    if (d != dependents.end()) {
+        vector<int> own;
+        own.swap(result);
+        merge(own.begin(), own.end(), d->second.begin(), d->second.end(),
+              back_inserter(result));
+        result.erase(unique(result.begin(), result.end()), result.end());
+    }
+    return result;
+}
+
+void DependencyGraph::PrintInvalidated(const char *name) {
+    vector<int> invalidated = Invalidated(name);
+    printf("Changing %s invalidates %d check%s%s\n", name,
+           (int)invalidated.size(), invalidated.size() == 1 ? "" : "s",
+           invalidated.empty() ? "" : ":");
+
+    for (size_t i = 0; i < invalidated.size(); i++) {
+        const DependencyNode &unit = units[invalidated[i]];
+        Decl *top = TopLevel(unit);
+        printf("    line %d: ", unit.decl->GetLocation()->first_line);
+        if (unit.inheritance)
+            printf("class %s\n", unit.decl->Name());
+        else if (top != unit.decl)
+            printf("%s.%s\n", top->Name(), unit.decl->Name());
+        else if (dynamic_cast<InterfaceDecl*>(unit.decl) != NULL)
+            printf("interface %s\n", unit.decl->Name());
+        else
+            printf("%s\n", unit.decl->Name());
+    }
+}
@@ -0,0 +1,64 @@
+/* File: dependencies.h
+ * --------------------
+ * The dependency graph of the program checked last. Its nodes are the
+ * units that the checks are split into (see incremental.h): a global
+ * function, variable or interface, a member of a class, or a class as a
+ * whole. A unit has an edge to each name it looked up in the global
+ * scope while it was checked. So a function body depends on the classes
+ * and members it resolved, by way of the names of the classes, and on
+ * the functions it called. A class as a whole depends on its
+ * superclasses and interfaces.
+ *
+ * Changing the declaration of a name invalidates the checks of its own
+ * units and of those with an edge to the name, and no others: the checks
+ * of its subclasses, of the classes implementing it and of the bodies
+ * referring to it. Walks up the class hierarchy look up each class on
+ * the way, so there is no need to follow edges any further.
+ *
+ * The graph is recorded when checking incrementally, or when it is
+ * queried with --invalidates=name. That prints the units whose checks a
+ * change to the declaration of name would invalidate. It is only ever
+ * recorded for a program of one file; for one that imports others (see
+ * imports.h), --invalidates prints that it cannot tell instead.
+ */
+
+#ifndef _H_dependencies
+#define _H_dependencies
+
+#include <vector>
+using namespace std;
+
+class Decl;
+
+struct DependencyNode
+{
+    Decl *decl;
+    bool inheritance;                   // the class decl as a whole
+    vector<const char*> dependencies;   // names looked up, interned
+};
+
+class DependencyGraph
+{
+  public:
+    // Forgets the graph, for the next program
+    static void Clear();
+
+    // Adds a unit: decl, or if inheritance is set, the class decl as a
+    // whole. Returns the unit's number.
+    static int AddUnit(Decl *decl, bool inheritance);
+
+    // Adds an edge from a unit to a name that it looked up
+    static void AddDependency(int unit, const char *name);
+
+    // Returns the units, indexed by number
+    static const vector<DependencyNode>& Units();
+
+    // Returns the numbers of the units whose checks a change to the
+    // declaration of name would invalidate, in order
+    static vector<int> Invalidated(const char *name);
+
+    // Prints the units that Invalidated() returns, one per line
+    static void PrintInvalidated(const char *name);
+};
+
+#endif
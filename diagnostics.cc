@@ -0,0 +1,310 @@
+/**
+ * File: diagnostics.cc
+ * --------------------
+ * Implementation of the diagnostics engine. Each thread appends to its
+ * own buffer without taking any lock; the lock is only needed the first
+ * time a thread reports (to register its buffer) and when the buffers
+ * are merged for output. The merged diagnostics are rendered into one
+ * string and written to stderr a megabyte at a time, rather than through
+ * the unbuffered cerr a few characters at a time.
+ */
+
+#include "diagnostics.h"
+#include <iostream>
+#include <algorithm>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "imports.h" // for GetFileLine
+#include "utility.h"
+
+/* Message formats, indexed by diagnosticT. A %n in the format is replaced
+ * by the n-th argument of the diagnostic.
+ */
+static const char *formats[NumDiagnosticKinds] = {
+    "Input ends with unterminated comment",
+    "Identifier too long: \"%0\"",
+    "Unterminated string constant: %0",
+    "Unrecognized char: '%0'",
+    "Integer constant out of range: %0",
+    "Double constant out of range: %0",
+    "Declaration of '%0' here conflicts with declaration on line %1",
+    "Method '%0' must match inherited type signature",
+    "Class '%0' does not implement entire interface '%1'",
+    "No declaration found for %0 '%1'",
+    "Incompatible operand: %0 %1",
+    "Incompatible operands: %0 %1 %2",
+    "'this' is only valid within class scope",
+    "[] can only be applied to arrays",
+    "Array subscript must be an integer",
+    "Size for NewArray must be an integer",
+    "Function '%0' expects %1 argument%2 but %3 given",
+    "Incompatible argument %0: %1 given, %2 expected",
+    "Incompatible argument %0: %1 given, int/bool/string expected",
+    "%0 has no such field '%1'",
+    "%0 field '%1' only accessible within class scope",
+    "Test expression must have boolean type",
+    "Incompatible return: %0 given, %1 expected",
+    "break is only allowed inside a loop",
+    "%0",
+};
+
+struct DiagnosticBuffer
+{
+    int index;
+    vector<Diagnostic> items;
+};
+
+static const size_t BatchSize = 1 << 20;   // bytes of output per write
+
+static pthread_mutex_t buffersLock = PTHREAD_MUTEX_INITIALIZER;
+static vector<DiagnosticBuffer*> buffers;
+static int numRecorded = 0;
+
+static __thread DiagnosticBuffer *threadBuffer = NULL;
+static __thread orderKeyT threadKey = 0;
+static __thread int threadFile = -1;
+static int currentFile = 0;
+
+
+void Diagnostic::AppendMessage(string &out) const {
+    for (const char *f = formats[kind]; *f; f++) {
+        if (*f == '%' && f[1] >= '0' && f[1] <= '9') {
+            unsigned int n = *++f - '0';
+            Assert(n < args.size());
+            out += args[n];
+        } else {
+            out += *f;
+        }
+    }
+}
+
+static DiagnosticBuffer *ThreadBuffer() {
+    if (threadBuffer == NULL) {
+        threadBuffer = new DiagnosticBuffer;
+        pthread_mutex_lock(&buffersLock);
+        threadBuffer->index = buffers.size();
+        buffers.push_back(threadBuffer);
+        pthread_mutex_unlock(&buffersLock);
+    }
+    return threadBuffer;
+}
+
+void Diagnostics::Record(diagnosticT kind, yyltype *loc,
+                         const DiagnosticArgs &args) {
+    DiagnosticBuffer *b = ThreadBuffer();
+    b->items.push_back(Diagnostic());
+
+    Diagnostic &d = b->items.back();
+    d.kind = kind;
+    d.hasLocation = (loc != NULL);
+    if (loc)
+        d.location = *loc;
+    d.args = args.args;
+    d.key = threadKey;
+    d.seq = b->items.size() - 1;
+    d.buffer = b->index;
+    d.file = GetFile();
+
+    __sync_fetch_and_add(&numRecorded, 1);
+}
+
+void Diagnostics::Replay(const Diagnostic &d) {
+    DiagnosticBuffer *b = ThreadBuffer();
+    b->items.push_back(d);
+
+    Diagnostic &copy = b->items.back();
+    copy.key = threadKey;
+    copy.seq = b->items.size() - 1;
+    copy.buffer = b->index;
+
+    __sync_fetch_and_add(&numRecorded, 1);
+}
+
+size_t Diagnostics::NumRecordedByThread() {
+    return ThreadBuffer()->items.size();
+}
+
+void Diagnostics::CopyRecordedSince(size_t n, vector<Diagnostic> &out) {
+    vector<Diagnostic> &items = ThreadBuffer()->items;
+    out.insert(out.end(), items.begin() + n, items.end());
+}
+
+void Diagnostics::SetOrderKey(orderKeyT key) {
+    threadKey = key;
+}
+
+orderKeyT Diagnostics::GetOrderKey() {
+    return threadKey;
+}
+
+void Diagnostics::SetFile(int file) {
+    currentFile = file;
+}
+
+void Diagnostics::SetThreadFile(int file) {
+    threadFile = file;
+}
+
+int Diagnostics::GetFile() {
+    return (threadFile >= 0 ? threadFile : currentFile);
+}
+
+int Diagnostics::NumRecorded() {
+    return numRecorded;
+}
+
+static bool InOrder(const Diagnostic *a, const Diagnostic *b) {
+    if (a->key != b->key)
+        return a->key < b->key;
+    if (a->buffer != b->buffer)
+        return a->buffer < b->buffer;
+    return a->seq < b->seq;
+}
+
+static void UnderlineErrorInLine(string &out, int file, int lineNum,
+                                 const yyltype *pos) {
+    size_t length;
+    const char *line = GetFileLine(file, lineNum, &length);
+    if (!line) return;
+    out.append(line, length);
+    out += '\n';
+    if (pos->last_column > 0) {
+        int spaces = min(max(pos->first_column - 1, 0), pos->last_column);
+        out.append(spaces, ' ');
+        out.append(pos->last_column - spaces, '^');
+    }
+    out += '\n';
+}
+
+static void Render(string &out, const Diagnostic *d) {
+    const char *name = GetFileName(d->file);
+    out += "\n*** Error";
+    if (name != NULL) {
+        out += " in ";
+        out += name;
+    }
+    if (d->hasLocation) {
+        char header[64];
+        snprintf(header, sizeof(header), " line %d.\n",
+                 d->location.first_line);
+        out += header;
+        UnderlineErrorInLine(out, d->file, d->location.first_line,
+                             &d->location);
+    } else
+        out += ".\n";
+    out += "*** ";
+    d->AppendMessage(out);
+    out += "\n\n";
+}
+
+/* Function: WriteAll
+ * ------------------
+ * Writes out the text with as few write() calls as it takes, which is
+ * one unless the output is a pipe that fills up or a signal interrupts.
+ */
+static void WriteAll(int fd, const string &text) {
+    const char *p = text.data();
+    size_t left = text.size();
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        p += n;
+        left -= n;
+    }
+}
+
+/* Function: Emit
+ * --------------
+ * Merges all thread buffers in order and renders them, capped by
+ * --max-errors, into out. If fd is not -1, the text is written there in
+ * batches as it goes, leaving out empty.
+ */
+static void Emit(string &out, int fd) {
+    pthread_mutex_lock(&buffersLock);
+
+    vector<const Diagnostic*> merged;
+    for (size_t i = 0; i < buffers.size(); i++)
+        for (size_t j = 0; j < buffers[i]->items.size(); j++)
+            merged.push_back(&buffers[i]->items[j]);
+
+    const char *max = GetOption("max-errors");
+    size_t shown = merged.size();
+    if (max != NULL && atoi(max) >= 0 && (size_t)atoi(max) < shown) {
+        shown = atoi(max);
+        partial_sort(merged.begin(), merged.begin() + shown, merged.end(),
+                     InOrder);
+    } else
+        sort(merged.begin(), merged.end(), InOrder);
+
+    for (size_t i = 0; i < shown; i++) {
+        Render(out, merged[i]);
+        if (fd != -1 && out.size() >= BatchSize) {
+            WriteAll(fd, out);
+            out.clear();
+        }
+    }
+    if (shown < merged.size()) {
+        char note[64];
+        snprintf(note, sizeof(note), "\n*** Too many errors: %lu more not "
+                 "shown.\n\n", (unsigned long)(merged.size() - shown));
+        out += note;
+    }
+    if (fd != -1) {
+        WriteAll(fd, out);
+        out.clear();
+    }
+
+    for (size_t i = 0; i < buffers.size(); i++)
+        buffers[i]->items.clear();
+    pthread_mutex_unlock(&buffersLock);
+}
+
+void Diagnostics::Flush() {
+    string out;
+    cerr.flush();
+    Emit(out, STDERR_FILENO);
+}
+
+void Diagnostics::Render(string &out) {
+    Emit(out, -1);
+}
+
+void Diagnostics::Clear() {
+    pthread_mutex_lock(&buffersLock);
+    for (size_t i = 0; i < buffers.size(); i++)
+        buffers[i]->items.clear();
+    numRecorded = 0;
+    pthread_mutex_unlock(&buffersLock);
+}
+
+void Diagnostics::DiscardFrom(orderKeyT key) {
+    pthread_mutex_lock(&buffersLock);
+    for (size_t i = 0; i < buffers.size(); i++) {
+        vector<Diagnostic> &items = buffers[i]->items;
+        size_t kept = 0;
+        for (size_t j = 0; j < items.size(); j++)
+            if (items[j].key < key)
+                items[kept++] = items[j];
+        __sync_fetch_and_sub(&numRecorded, items.size() - kept);
+        items.resize(kept);
+    }
+    pthread_mutex_unlock(&buffersLock);
+}
+
+void Diagnostics::ShiftKeys(orderKeyT from, orderKeyT to, orderKeyT newFrom) {
+    pthread_mutex_lock(&buffersLock);
+    for (size_t i = 0; i < buffers.size(); i++) {
+        vector<Diagnostic> &items = buffers[i]->items;
+        for (size_t j = 0; j < items.size(); j++)
+            if (items[j].key >= from && items[j].key < to)
+                items[j].key = items[j].key - from + newFrom;
+    }
+    pthread_mutex_unlock(&buffersLock);
+}
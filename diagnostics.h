@@ -0,0 +1,141 @@
+/**
+ * File: diagnostics.h
+ * -------------------
+ * This file defines the diagnostics engine that sits behind ReportError.
+ * Rather than writing each error to cerr the moment it is found, every
+ * error is recorded as a structured Diagnostic (kind, location and the
+ * arguments that fill in its message) into a buffer owned by the
+ * reporting thread. Once the compiler is done, the buffers are merged
+ * and rendered in one go, in exactly the text format the samples expect.
+ *
+ * Ordering: each thread carries an order key, set via SetOrderKey().
+ * Diagnostics are rendered sorted by order key, and diagnostics with
+ * equal keys in the order they were recorded. A single-threaded run that
+ * never touches the key thus renders in reporting order, while a phase
+ * running on several threads can stamp its work with keys that
+ * reproduce the sequential traversal order.
+ *
+ * In a program of several files (see imports.h), each diagnostic also
+ * notes the file it is in, which is named in its header.
+ */
+
+#ifndef _H_diagnostics
+#define _H_diagnostics
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include "location.h"
+using namespace std;
+
+/* One kind per standard Decaf error. The order must match the table of
+ * message formats in diagnostics.cc.
+ */
+typedef enum {
+    DiagUntermComment, DiagLongIdentifier, DiagUntermString, DiagUnrecogChar,
+    DiagIntegerOutOfRange, DiagDoubleOutOfRange,
+    DiagDeclConflict, DiagOverrideMismatch, DiagInterfaceNotImplemented,
+    DiagIdentifierNotDeclared, DiagIncompatibleOperand,
+    DiagIncompatibleOperands, DiagThisOutsideClassScope,
+    DiagBracketsOnNonArray, DiagSubscriptNotInteger,
+    DiagNewArraySizeNotInteger, DiagNumArgsMismatch, DiagArgMismatch,
+    DiagPrintArgMismatch, DiagFieldNotFoundInBase, DiagInaccessibleField,
+    DiagTestNotBoolean, DiagReturnMismatch, DiagBreakOutsideLoop,
+    DiagFormatted, NumDiagnosticKinds
+} diagnosticT;
+
+typedef unsigned long long orderKeyT;
+
+/* Class: DiagnosticArgs
+ * ---------------------
+ * Collects the arguments of a diagnostic, each converted to its text
+ * form with the usual stream insertion operators, e.g.
+ *
+ *    DiagnosticArgs() << decl << prevDecl->GetLocation()->first_line
+ */
+class DiagnosticArgs
+{
+  public:
+    vector<string> args;
+
+    template <class T> DiagnosticArgs& operator<<(const T &value) {
+        ostringstream s;
+        s << value;
+        args.push_back(s.str());
+        return *this;
+    }
+};
+
+struct Diagnostic
+{
+    diagnosticT kind;
+    bool hasLocation;
+    yyltype location;
+    vector<string> args;
+    orderKeyT key;
+    int seq;                    // recording order within its buffer
+    int buffer;                 // index of the recording thread's buffer
+    int file;                   // number of the file it is in, see imports.h
+
+    // Appends the message, with the arguments filled in, to out
+    void AppendMessage(string &out) const;
+};
+
+class Diagnostics
+{
+  public:
+    // Records a diagnostic into the calling thread's buffer.
+    // loc may be NULL when there is no position to point out.
+    static void Record(diagnosticT kind, yyltype *loc,
+                       const DiagnosticArgs &args);
+
+    // Records a copy of a diagnostic recorded before, e.g. in an earlier
+    // compile, stamped as though it had just been reported
+    static void Replay(const Diagnostic &d);
+
+    // Returns how many diagnostics the calling thread has recorded since
+    // they were last cleared, for CopyRecordedSince()
+    static size_t NumRecordedByThread();
+
+    // Appends to out copies of the diagnostics that the calling thread
+    // recorded after the first n
+    static void CopyRecordedSince(size_t n, vector<Diagnostic> &out);
+
+    // Sets/gets the order key stamped on the calling thread's diagnostics
+    static void SetOrderKey(orderKeyT key);
+    static orderKeyT GetOrderKey();
+
+    // Sets the number of the file that diagnostics are in, for threads
+    // that have not set their own with SetThreadFile(); -1 there goes
+    // back to this one. GetFile() returns the number the calling thread's
+    // diagnostics get.
+    static void SetFile(int file);
+    static void SetThreadFile(int file);
+    static int GetFile();
+
+    // Returns the number of diagnostics recorded and not yet cleared
+    static int NumRecorded();
+
+    // Merges all thread buffers in order and writes them to stderr,
+    // then clears them. With --max-errors=N, only the first N are
+    // written, followed by a count of the rest.
+    static void Flush();
+
+    // Like Flush(), but appends the text to out instead.
+    static void Render(string &out);
+
+    // Discards everything recorded so far.
+    static void Clear();
+
+    // Discards the diagnostics whose order key is at least the given key,
+    // e.g. those a phase recorded for work that turned out to be unneeded.
+    static void DiscardFrom(orderKeyT key);
+
+    // Moves the diagnostics with order keys in [from, to) so that their
+    // keys start at newFrom instead, keeping their relative order. For a
+    // phase that stamps its work with provisional keys before it knows
+    // where that work falls in the sequential order.
+    static void ShiftKeys(orderKeyT from, orderKeyT to, orderKeyT newFrom);
+};
+
+#endif
@@ -1,43 +1,24 @@
 /**
  * File: errors.cc
  * ---------------
- * Implementation for error-reporting class.
+ * Implementation for error-reporting class. Each method packages up the
+ * arguments of its message and hands them to the diagnostics engine,
+ * which renders everything once the compiler is done.
  */
 
 #include "errors.h"
-#include <iostream>
-#include <sstream>
 #include <stdarg.h>
 #include <stdio.h>
 using namespace std;
-#include "scanner.h" // for GetLineNumbered
 #include "ast_type.h"
 #include "ast_expr.h"
 #include "ast_stmt.h"
 #include "ast_decl.h"
 
 
-int ReportError::numErrors = 0;
-
-void ReportError::UnderlineErrorInLine(const char *line, yyltype *pos) {
-    if (!line) return;
-    cerr << line << endl;
-    for (int i = 1; i <= pos->last_column; i++)
-        cerr << (i >= pos->first_column ? '^' : ' ');
-    cerr << endl;
-}
-
- 
- 
-void ReportError::OutputError(yyltype *loc, string msg) {
-    numErrors++;
-    fflush(stdout); // make sure any buffered text has been output
-    if (loc) {
-        cerr << endl << "*** Error line " << loc->first_line << "." << endl;
-        UnderlineErrorInLine(GetLineNumbered(loc->first_line), loc);
-    } else
-        cerr << endl << "*** Error." << endl;
-    cerr << "*** " << msg << endl << endl;
+void ReportError::OutputError(yyltype *loc, diagnosticT kind,
+                              const DiagnosticArgs &args) {
+    Diagnostics::Record(kind, loc, args);
 }
 
 
@@ -48,131 +29,119 @@ void ReportError::Formatted(yyltype *loc, const char *format, ...) {
     va_start(args, format);
     vsprintf(errbuf,format, args);
     va_end(args);
-    OutputError(loc, errbuf);
+    OutputError(loc, DiagFormatted, DiagnosticArgs() << errbuf);
 }
 
 void ReportError::UntermComment() {
-    OutputError(NULL, "Input ends with unterminated comment");
+    OutputError(NULL, DiagUntermComment);
 }
 
 
 void ReportError::LongIdentifier(yyltype *loc, const char *ident) {
-    ostringstream s;
-    s << "Identifier too long: \"" << ident << "\"";
-    OutputError(loc, s.str());
+    OutputError(loc, DiagLongIdentifier, DiagnosticArgs() << ident);
 }
 
 void ReportError::UntermString(yyltype *loc, const char *str) {
-    ostringstream s;
-    s << "Unterminated string constant: " << str;
-    OutputError(loc, s.str());
+    OutputError(loc, DiagUntermString, DiagnosticArgs() << str);
 }
 
 void ReportError::UnrecogChar(yyltype *loc, char ch) {
-    ostringstream s;
-    s << "Unrecognized char: '" << ch << "'";
-    OutputError(loc, s.str());
+    OutputError(loc, DiagUnrecogChar, DiagnosticArgs() << ch);
+}
+
+void ReportError::IntegerOutOfRange(yyltype *loc, const char *literal) {
+    OutputError(loc, DiagIntegerOutOfRange, DiagnosticArgs() << literal);
+}
+
+void ReportError::DoubleOutOfRange(yyltype *loc, const char *literal) {
+    OutputError(loc, DiagDoubleOutOfRange, DiagnosticArgs() << literal);
 }
 
 void ReportError::DeclConflict(Decl *decl, Decl *prevDecl) {
-    ostringstream s;
-    s << "Declaration of '" << decl << "' here conflicts with declaration on line " 
-      << prevDecl->GetLocation()->first_line;
-    OutputError(decl->GetLocation(), s.str());
+    OutputError(decl->GetLocation(), DiagDeclConflict,
+                DiagnosticArgs() << decl << prevDecl->GetLocation()->first_line);
 }
   
 void ReportError::OverrideMismatch(Decl *fnDecl) {
-    ostringstream s;
-    s << "Method '" << fnDecl << "' must match inherited type signature";
-    OutputError(fnDecl->GetLocation(), s.str());
+    OutputError(fnDecl->GetLocation(), DiagOverrideMismatch,
+                DiagnosticArgs() << fnDecl);
 }
 
 void ReportError::InterfaceNotImplemented(Decl *cd, Type *interfaceType) {
-    ostringstream s;
-    s << "Class '" << cd << "' does not implement entire interface '" << interfaceType << "'";
-    OutputError(interfaceType->GetLocation(), s.str());
+    OutputError(interfaceType->GetLocation(), DiagInterfaceNotImplemented,
+                DiagnosticArgs() << cd << interfaceType);
 }
 
 void ReportError::IdentifierNotDeclared(Identifier *ident, reasonT whyNeeded) {
-    ostringstream s;
     static const char *names[] =  {"type", "class", "interface", "variable", "function"};
     Assert(whyNeeded >= 0 && whyNeeded <= sizeof(names)/sizeof(names[0]));
-    s << "No declaration found for "<< names[whyNeeded] << " '" << ident << "'";
-    OutputError(ident->GetLocation(), s.str());
+    OutputError(ident->GetLocation(), DiagIdentifierNotDeclared,
+                DiagnosticArgs() << names[whyNeeded] << ident);
 }
 
 void ReportError::IncompatibleOperands(Operator *op, Type *lhs, Type *rhs) {
-    ostringstream s;
-    s << "Incompatible operands: " << lhs << " " << op << " " << rhs;
-    OutputError(op->GetLocation(), s.str());
+    OutputError(op->GetLocation(), DiagIncompatibleOperands,
+                DiagnosticArgs() << lhs << op << rhs);
 }
      
 void ReportError::IncompatibleOperand(Operator *op, Type *rhs) {
-    ostringstream s;
-    s << "Incompatible operand: " << op << " " << rhs;
-    OutputError(op->GetLocation(), s.str());
+    OutputError(op->GetLocation(), DiagIncompatibleOperand,
+                DiagnosticArgs() << op << rhs);
 }
 
 void ReportError::ThisOutsideClassScope(This *th) {
-    OutputError(th->GetLocation(), "'this' is only valid within class scope");
+    OutputError(th->GetLocation(), DiagThisOutsideClassScope);
 }
 
 void ReportError::BracketsOnNonArray(Expr *baseExpr) {
-    OutputError(baseExpr->GetLocation(), "[] can only be applied to arrays");
+    OutputError(baseExpr->GetLocation(), DiagBracketsOnNonArray);
 }
 
 void ReportError::SubscriptNotInteger(Expr *subscriptExpr) {
-    OutputError(subscriptExpr->GetLocation(), "Array subscript must be an integer");
+    OutputError(subscriptExpr->GetLocation(), DiagSubscriptNotInteger);
 }
 
 void ReportError::NewArraySizeNotInteger(Expr *sizeExpr) {
-    OutputError(sizeExpr->GetLocation(), "Size for NewArray must be an integer");
+    OutputError(sizeExpr->GetLocation(), DiagNewArraySizeNotInteger);
 }
 
 void ReportError::NumArgsMismatch(Identifier *fnIdent, int numExpected, int numGiven) {
-    ostringstream s;
-    s << "Function '"<< fnIdent << "' expects " << numExpected << " argument" << (numExpected==1?"":"s") 
-      << " but " << numGiven << " given";
-    OutputError(fnIdent->GetLocation(), s.str());
+    OutputError(fnIdent->GetLocation(), DiagNumArgsMismatch,
+                DiagnosticArgs() << fnIdent << numExpected
+                                 << (numExpected==1?"":"s") << numGiven);
 }
 
 void ReportError::ArgMismatch(Expr *arg, int argIndex, Type *given, Type *expected) {
-  ostringstream s;
-  s << "Incompatible argument " << argIndex << ": " << given << " given, " << expected << " expected";
-  OutputError(arg->GetLocation(), s.str());
+  OutputError(arg->GetLocation(), DiagArgMismatch,
+              DiagnosticArgs() << argIndex << given << expected);
 }
 
 void ReportError::ReturnMismatch(ReturnStmt *rStmt, Type *given, Type *expected) {
-    ostringstream s;
-    s << "Incompatible return: " << given << " given, " << expected << " expected";
-    OutputError(rStmt->GetLocation(), s.str());
+    OutputError(rStmt->GetLocation(), DiagReturnMismatch,
+                DiagnosticArgs() << given << expected);
 }
 
 void ReportError::FieldNotFoundInBase(Identifier *field, Type *base) {
-    ostringstream s;
-    s << base << " has no such field '" << field <<"'";
-    OutputError(field->GetLocation(), s.str());
+    OutputError(field->GetLocation(), DiagFieldNotFoundInBase,
+                DiagnosticArgs() << base << field);
 }
      
 void ReportError::InaccessibleField(Identifier *field, Type *base) {
-    ostringstream s;
-    s  << base << " field '" << field << "' only accessible within class scope";
-    OutputError(field->GetLocation(), s.str());
+    OutputError(field->GetLocation(), DiagInaccessibleField,
+                DiagnosticArgs() << base << field);
 }
 
 void ReportError::PrintArgMismatch(Expr *arg, int argIndex, Type *given) {
-    ostringstream s;
-    s << "Incompatible argument " << argIndex << ": " << given
-        << " given, int/bool/string expected";
-    OutputError(arg->GetLocation(), s.str());
+    OutputError(arg->GetLocation(), DiagPrintArgMismatch,
+                DiagnosticArgs() << argIndex << given);
 }
 
 void ReportError::TestNotBoolean(Expr *expr) {
-    OutputError(expr->GetLocation(), "Test expression must have boolean type");
+    OutputError(expr->GetLocation(), DiagTestNotBoolean);
 }
 
 void ReportError::BreakOutsideLoop(BreakStmt *bStmt) {
-    OutputError(bStmt->GetLocation(), "break is only allowed inside a loop");
+    OutputError(bStmt->GetLocation(), DiagBreakOutsideLoop);
 }
   
 /**
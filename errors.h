@@ -15,6 +15,7 @@
 
 #include <string>
 #include "location.h"
+#include "diagnostics.h"
 using namespace std;
 class Type;
 class Identifier;
@@ -57,6 +58,8 @@ class ReportError {
   static void LongIdentifier(yyltype *loc, const char *ident);
   static void UntermString(yyltype *loc, const char *str);
   static void UnrecogChar(yyltype *loc, char ch);
+  static void IntegerOutOfRange(yyltype *loc, const char *literal);
+  static void DoubleOutOfRange(yyltype *loc, const char *literal);
 
   
   // Errors used by semantic analyzer for declarations
@@ -102,12 +105,14 @@ class ReportError {
   static void Formatted(yyltype *loc, const char *format, ...);
 
 
-  // Returns number of error messages printed
-  static int NumErrors() { return numErrors; }
+  // Returns number of error messages reported
+  static int NumErrors() { return Diagnostics::NumRecorded(); }
+
+  // Writes out all errors reported so far, in traversal order
+  static void Flush() { Diagnostics::Flush(); }
   
  private:
-  static void UnderlineErrorInLine(const char *line, yyltype *pos);
-  static void OutputError(yyltype *loc, string msg);
-  static int numErrors;
+  static void OutputError(yyltype *loc, diagnosticT kind,
+                          const DiagnosticArgs &args = DiagnosticArgs());
 };
 #endif
@@ -0,0 +1,396 @@
+/* File: fast_scanner.cc
+ * ---------------------
+ * Implementation of the hand-written scanner. Each case below mirrors a
+ * rule of scanner.l; where flex would match a run of lexemes one at a
+ * time (each character of a comment body, say), only their total effect
+ * on the line, column and location is applied.
+ */
+
+#include "fast_scanner.h"
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include "scanner.h"
+#include "utility.h"
+#include "errors.h"
+#include "keywords.h"
+#include "intern.h"
+#include "literals.h"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define TAB_SIZE 8
+
+/* The kinds of run that are skipped a vector at a time. */
+typedef enum { SpaceRun, CommentRun, StringRun, IdentifierRun,
+               NumRunKinds } runT;
+
+typedef const char *(*skipFn)(const char *p, const char *end);
+
+/* For each kind of run, the function returning the first character at or
+ * after p that ends the run (or end), as picked by InitFastScanner.
+ */
+static skipFn skip[NumRunKinds];
+
+
+static inline bool IsDigit(char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+static inline bool IsHexDigit(char c) {
+    return IsDigit(c) || (unsigned char)((c | 0x20) - 'a') < 6;
+}
+
+static inline bool IsLetter(char c) {
+    return (unsigned char)((c | 0x20) - 'a') < 26;
+}
+
+/* Function: EndsRun
+ * -----------------
+ * Tells whether c ends a run of the given kind: anything but a space for
+ * spaces; a '*' (which may start the end of the comment), newline or tab
+ * in a comment body, which flex matches with rules of their own; a quote
+ * or newline in a string; anything but a letter, digit or underscore in
+ * an identifier.
+ */
+static inline bool EndsRun(runT kind, char c) {
+    switch (kind) {
+      case SpaceRun:   return c != ' ';
+      case CommentRun: return c == '*' || c == '\n' || c == '\t';
+      case StringRun:  return c == '"' || c == '\n';
+      default:         return !(IsLetter(c) || IsDigit(c) || c == '_');
+    }
+}
+
+template <runT Kind>
+static const char *SkipScalar(const char *p, const char *end) {
+    while (p < end && !EndsRun(Kind, *p))
+        p++;
+    return p;
+}
+
+#if defined(__x86_64__)
+
+/* SSE2 is part of x86-64, so needs no check. Each function computes the
+ * mask of the bytes in a vector that end the run and stops at the first.
+ */
+static inline __m128i InRange16(__m128i v, char lo, char hi) {
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(hi - lo)), d);
+}
+
+template <runT Kind>
+static inline unsigned int EndMask16(__m128i v) {
+    __m128i m;
+    switch (Kind) {
+      case SpaceRun:
+        return ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(' '))) & 0xFFFF;
+      case CommentRun:
+        m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('*')),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                      _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+        return _mm_movemask_epi8(m);
+      case StringRun:
+        m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        return _mm_movemask_epi8(m);
+      default:
+        m = _mm_or_si128(InRange16(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'),
+                         _mm_or_si128(InRange16(v, '0', '9'),
+                                      _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))));
+        return ~_mm_movemask_epi8(m) & 0xFFFF;
+    }
+}
+
+template <runT Kind>
+static const char *SkipSSE2(const char *p, const char *end) {
+    for (; end - p >= 16; p += 16) {
+        unsigned int mask = EndMask16<Kind>(_mm_loadu_si128((const __m128i *)p));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return SkipScalar<Kind>(p, end);
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i InRange32(__m256i v, char lo, char hi) {
+    __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(hi - lo)), d);
+}
+
+template <runT Kind>
+AVX2 static inline unsigned int EndMask32(__m256i v) {
+    __m256i m;
+    switch (Kind) {
+      case SpaceRun:
+        return ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+      case CommentRun:
+        m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+        return _mm256_movemask_epi8(m);
+      case StringRun:
+        m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        return _mm256_movemask_epi8(m);
+      default:
+        m = _mm256_or_si256(InRange32(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z'),
+                            _mm256_or_si256(InRange32(v, '0', '9'),
+                                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))));
+        return ~_mm256_movemask_epi8(m);
+    }
+}
+
+template <runT Kind>
+AVX2 static const char *SkipAVX2(const char *p, const char *end) {
+    for (; end - p >= 32; p += 32) {
+        unsigned int mask = EndMask32<Kind>(_mm256_loadu_si256((const __m256i *)p));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return SkipSSE2<Kind>(p, end);
+}
+
+#endif
+
+void InitFastScanner(const char *isa) {
+    if (*isa == '\0') {
+#if defined(__x86_64__)
+        isa = (__builtin_cpu_supports("avx2") ? "avx2" : "sse2");
+#else
+        isa = "scalar";
+#endif
+    }
+    PrintDebug("lex", "Fast scanner using %s", isa);
+
+    if (!strcmp(isa, "scalar")) {
+        skip[SpaceRun] = SkipScalar<SpaceRun>;
+        skip[CommentRun] = SkipScalar<CommentRun>;
+        skip[StringRun] = SkipScalar<StringRun>;
+        skip[IdentifierRun] = SkipScalar<IdentifierRun>;
+#if defined(__x86_64__)
+    } else if (!strcmp(isa, "sse2")) {
+        skip[SpaceRun] = SkipSSE2<SpaceRun>;
+        skip[CommentRun] = SkipSSE2<CommentRun>;
+        skip[StringRun] = SkipSSE2<StringRun>;
+        skip[IdentifierRun] = SkipSSE2<IdentifierRun>;
+    } else if (!strcmp(isa, "avx2") && __builtin_cpu_supports("avx2")) {
+        skip[SpaceRun] = SkipAVX2<SpaceRun>;
+        skip[CommentRun] = SkipAVX2<CommentRun>;
+        skip[StringRun] = SkipAVX2<StringRun>;
+        skip[IdentifierRun] = SkipAVX2<IdentifierRun>;
+#endif
+    } else {
+        Failure("Unsupported instruction set for --fast-scan: %s", isa);
+    }
+}
+
+
+/* Function: Match
+ * ---------------
+ * Consumes a lexeme of the given length, doing what DoBeforeEachAction
+ * in scanner.l does for each flex match: record its location and move
+ * the column on. Returns the start of the lexeme.
+ */
+static inline const char *Match(ScanState *s, size_t length) {
+    const char *start = s->next;
+    yyltype *loc = s->tokenLocation;
+    loc->first_line = s->curLineNum;
+    loc->first_column = s->curColNum;
+    loc->last_line = s->curLineNum;
+    loc->last_column = s->curColNum + length - 1;
+    s->curColNum += length;
+    s->offset += length;
+    s->next += length;
+    return start;
+}
+
+static inline void MatchNewline(ScanState *s) {
+    Match(s, 1);
+    s->curLineNum++;
+    s->curColNum = 1;
+    s->lineStarts->push_back(s->offset);
+}
+
+static inline void MatchTab(ScanState *s) {
+    Match(s, 1);
+    s->curColNum += TAB_SIZE - s->curColNum%TAB_SIZE + 1;
+}
+
+/* Function: SkipCommentBody
+ * -------------------------
+ * Scans the inside of a comment up to and including the end of comment.
+ * Returns false if the input ends first.
+ */
+static bool SkipCommentBody(ScanState *s) {
+    for (;;) {
+        const char *stop = skip[CommentRun](s->next, s->end);
+        if (stop > s->next) {
+            // every character is a lexeme of its own to flex,
+            // leaving the location of the last one
+            size_t n = stop - s->next;
+            s->curColNum += n - 1;
+            s->offset += n - 1;
+            s->next += n - 1;
+            Match(s, 1);
+        }
+        if (stop == s->end)
+            return false;
+        if (*stop == '\n')
+            MatchNewline(s);
+        else if (*stop == '\t')
+            MatchTab(s);
+        else if (stop + 1 < s->end && stop[1] == '/') {
+            Match(s, 2);
+            s->inComment = false;
+            return true;
+        } else
+            Match(s, 1);
+    }
+}
+
+/* Function: ScanNumber
+ * --------------------
+ * Matches the longest of the INTEGER, HEX_INTEGER and DOUBLE patterns
+ * starting at the digit at p and sets the token's value.
+ */
+static int ScanNumber(ScanState *s) {
+    const char *p = s->next, *end = s->end;
+    const char *q = p;
+    while (q < end && IsDigit(*q))
+        q++;
+    const char *longest = q;
+    int code = T_IntConstant, base = 10;
+
+    if (*p == '0' && p + 1 < end && (p[1] | 0x20) == 'x') {
+        const char *h = p + 2;
+        while (h < end && IsHexDigit(*h))
+            h++;
+        if (h > p + 2 && h > longest)
+            longest = h, base = 16;
+    }
+    if (q < end && *q == '.') {
+        const char *d = q + 1;
+        while (d < end && IsDigit(*d))
+            d++;
+        if (d < end && (*d | 0x20) == 'e') {
+            const char *x = d + 1;
+            if (x < end && (*x == '+' || *x == '-'))
+                x++;
+            const char *y = x;
+            while (y < end && IsDigit(*y))
+                y++;
+            if (y > x)
+                d = y;
+        }
+        if (d > longest)
+            longest = d, code = T_DoubleConstant;
+    }
+
+    Match(s, longest - p);
+    if (code == T_DoubleConstant)
+        s->tokenValue->doubleConstant = DecodeDouble(p, longest - p,
+                                                     s->tokenLocation);
+    else
+        s->tokenValue->integerConstant = DecodeInteger(p, longest - p, base,
+                                                       s->tokenLocation);
+    return code;
+}
+
+static int ScanIdentifier(ScanState *s) {
+    const char *p = s->next;
+    size_t length = skip[IdentifierRun](p + 1, s->end) - p;
+    Match(s, length);
+
+    int code = LookupKeyword(p, length);
+    if (code == T_BoolConstant)
+        s->tokenValue->boolConstant = (*p == 't');
+    if (code != 0)
+        return code;
+    if (length > MaxIdentLen)
+        ReportError::LongIdentifier(s->tokenLocation, string(p, length).c_str());
+    if (length > MaxIdentLen)
+        length = MaxIdentLen;
+    s->tokenValue->identifier = Intern(p, length, HashName(p, length));
+    return T_Identifier;
+}
+
+/* Function: ScanString
+ * --------------------
+ * Matches the STRING pattern, or reports BEG_STRING if the string is
+ * not closed on its line. Returns 0 in the latter case.
+ */
+static int ScanString(ScanState *s) {
+    const char *p = s->next;
+    const char *stop = skip[StringRun](p + 1, s->end);
+    if (stop < s->end && *stop == '"') {
+        Match(s, stop + 1 - p);
+        s->tokenValue->stringConstant = strndup(p, stop + 1 - p);
+        return T_StringConstant;
+    }
+    Match(s, stop - p);
+    ReportError::UntermString(s->tokenLocation, string(p, stop - p).c_str());
+    return 0;
+}
+
+/* Two-character operators, tried before the single-character ones. */
+static int LookupOperator(char first, char second) {
+    switch (first) {
+      case '<': return (second == '=' ? T_LessEqual : 0);
+      case '>': return (second == '=' ? T_GreaterEqual : 0);
+      case '=': return (second == '=' ? T_Equal : 0);
+      case '!': return (second == '=' ? T_NotEqual : 0);
+      case '&': return (second == '&' ? T_And : 0);
+      case '|': return (second == '|' ? T_Or : 0);
+      case '[': return (second == ']' ? T_Dims : 0);
+      default:  return 0;
+    }
+}
+
+int FastScan(ScanState *s) {
+    for (;;) {
+        if (s->inComment && !SkipCommentBody(s)) {
+            if (s->endsInput)
+                ReportError::UntermComment();
+            return 0;
+        }
+        if (s->next == s->end)
+            return 0;
+
+        const char *p = s->next;
+        char c = *p, next = (p + 1 < s->end ? p[1] : '\0');
+        int code;
+
+        if (c == '\n')
+            MatchNewline(s);
+        else if (c == ' ')
+            Match(s, skip[SpaceRun](p + 1, s->end) - p);
+        else if (c == '\t')
+            MatchTab(s);
+        else if (c == '/' && next == '*') {
+            Match(s, 2);
+            s->inComment = true;
+        } else if (c == '/' && next == '/') {
+            const char *newline = (const char *)memchr(p, '\n', s->end - p);
+            Match(s, (newline ? newline : s->end) - p);
+        } else if (IsLetter(c))
+            return ScanIdentifier(s);
+        else if (IsDigit(c))
+            return ScanNumber(s);
+        else if (c == '"') {
+            if ((code = ScanString(s)) != 0)
+                return code;
+        } else if (p + 1 < s->end && (code = LookupOperator(c, next)) != 0) {
+            Match(s, 2);
+            return code;
+        } else if (c != '\0' && strchr("-+/*%=.,;!<>()[]{}", c)) {
+            Match(s, 1);
+            return c;
+        } else {
+            Match(s, 1);
+            ReportError::UnrecogChar(s->tokenLocation, c);
+        }
+    }
+}
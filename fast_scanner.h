@@ -0,0 +1,27 @@
+/* File: fast_scanner.h
+ * --------------------
+ * A hand-written scanner that can stand in for the flex one (--fast-scan).
+ * It works straight on the source text in memory and gets through the
+ * long runs that make up most of a program (spaces, comment bodies,
+ * string literals and identifiers) a vector of 16 or 32 bytes at a time.
+ * SSE2 or AVX2 is picked at run time, with a plain loop as the fallback.
+ *
+ * The fast scanner behaves exactly like the rules in scanner.l: it finds
+ * the same tokens with the same values and locations, reports the same
+ * errors, and even leaves the location of the last lexeme behind at end
+ * of input, just as flex does.
+ */
+
+#ifndef _H_fast_scanner
+#define _H_fast_scanner
+
+#include "token_stream.h" // for ScanState
+
+// Picks the vector instructions to use: "avx2", "sse2" or "scalar", or
+// the best the processor supports if isa is empty.
+void InitFastScanner(const char *isa);
+
+// Scans the next token; the counterpart of flex's scanning function
+int FastScan(ScanState *state);
+
+#endif
@@ -0,0 +1,570 @@
+/* File: imports.cc
+ * ----------------
+ * Implementation of programs of several files. The files are numbered
+ * in the order they are found, the first file 0, and known by their
+ * real paths so that each is loaded once whatever it is imported as.
+ * Once all are parsed, a depth-first walk of the imports from the first
+ * file lists them in dependency order, which is the order their errors
+ * go in, and finds any cycles on the way. With --incremental, what
+ * checking each file came to is kept by its real path, keyed by its text
+ * and the signatures of the files it sees, see KeyChecks.
+ */
+
+#include "imports.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast_decl.h"
+#include "ast_stmt.h"
+#include "diagnostics.h"
+#include "errors.h"
+#include "incremental.h"        // for HashSignatures
+#include "parser.h"
+#include "position_index.h"
+#include "rd_parser.h"
+#include "scanner.h"            // for GetLineNumbered
+#include "sha256.h"
+#include "source.h"
+#include "token_stream.h"       // for lineStarts
+#include "utility.h"
+#include "xref.h"
+using namespace std;
+
+struct Import
+{
+    string path;                // as written
+    yyltype location;
+};
+
+// What checking a file came to, kept for the next compile
+struct CheckedFile
+{
+    string key;                 // see KeyChecks
+    vector<Diagnostic> diagnostics;
+};
+
+/* Struct: ProgramFile
+ * -------------------
+ * A file of the program. The text of the first file is the source
+ * opened by OpenSource(), where the lines quoted with its errors come
+ * from; the others keep their own. Once the files are ordered, scope
+ * holds the declarations each one can see.
+ */
+struct ProgramFile
+{
+    string name;                // as shown with errors
+    string dir;                 // "" or ending in '/'
+    string real;                // its real path, or "-" for standard input
+    string text;
+    vector<size_t> lineStarts;
+    List<Decl*> *decls;         // NULL unless it parsed without errors
+    vector<Import> imports;
+    vector<int> dependencies;   // files imported, by number, each once
+    vector<size_t> via;         // the import of each, by index
+    vector<int> importers;      // files that import it
+    Scope *scope;
+    orderKeyT key;              // of its errors, see Check
+    string checkKey;            // with --incremental, or "" if it has none
+    CheckedFile *last;          // the last check to reuse, or NULL
+    vector<Diagnostic> diagnostics;     // from checking it, to keep
+
+    ProgramFile() : decls(NULL), scope(NULL), key(0), last(NULL) {}
+};
+
+static vector<ProgramFile*> files;
+static unordered_map<string, int> numbers;      // of the files, by real path
+static unordered_map<Decl*, int> owners;        // top-level, by file
+static int parsing;             // number of the file being parsed
+static bool anyImports;
+static unordered_map<string, CheckedFile> lastChecks;  // by real path
+static vector<string> missing;  // imports that could not be read, see Load
+
+// Keys of the errors from each file's declarations and checks, in
+// dependency order; those from loading the files come first, at key 0
+static const orderKeyT FileKeys = (orderKeyT)1 << 40;
+
+// Where the threads checking files take their work from
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueChanged = PTHREAD_COND_INITIALIZER;
+static vector<int> ready;       // files whose imports are all checked
+static vector<int> waitingFor;  // by file, imports not yet checked
+static int numUnchecked;
+
+
+void BeginImports(const char *path) {
+    for (size_t i = 0; i < files.size(); i++)
+        delete files[i];
+    files.clear();
+    numbers.clear();
+    owners.clear();
+    missing.clear();
+    parsing = 0;
+    anyImports = false;
+    Diagnostics::SetFile(0);
+
+    ProgramFile *first = new ProgramFile;
+    first->name = (path != NULL ? path : "<stdin>");
+    const char *slash = (path != NULL ? strrchr(path, '/') : NULL);
+    if (slash != NULL)
+        first->dir.assign(path, slash + 1 - path);
+    files.push_back(first);
+
+    char real[PATH_MAX];
+    first->real = "-";
+    if (path != NULL && realpath(path, real) != NULL) {
+        numbers[real] = 0;
+        first->real = real;
+    }
+}
+
+void NoteImport(const char *quoted, yyltype *loc) {
+    Import import;
+    import.path.assign(quoted + 1, strlen(quoted) - 2);
+    import.location = *loc;
+    files[parsing]->imports.push_back(import);
+    anyImports = true;
+}
+
+bool HasImports() {
+    return anyImports;
+}
+
+bool DeferCheck(List<Decl*> *decls) {
+    if (!anyImports)
+        return false;
+    files[parsing]->decls = decls;
+    return true;
+}
+
+static bool ReadFile(const string &path, string &text) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+        text.append(buffer, n);
+    close(fd);
+    return n == 0;
+}
+
+// Parses file number n, with the parser chosen for the first one; its
+// nodes are left out of the position index, which is of the first file
+static void Parse(int n) {
+    ProgramFile *f = files[n];
+    PrintDebug("imports", "Parsing %s", f->name.c_str());
+    bool indexing = indexingPositions;
+    indexingPositions = false;
+    parsing = n;
+    Diagnostics::SetFile(n);
+    OpenSourceText(f->text.data(), f->text.size());
+    InitScanner();
+    InitParser();
+    InitTokenStream();
+    if (GetOption("rd-parse"))
+        ParseRecursiveDescent();
+    else
+        yyparse();
+    FinishTokenStream();
+    f->lineStarts.swap(lineStarts);
+    indexingPositions = indexing;
+}
+
+/* Function: Load
+ * --------------
+ * Loads the file that file number n imports as import, if it has not
+ * been loaded already, and returns its number, or -1 if it cannot be
+ * read. The path of one that cannot is kept in missing, made absolute
+ * by the real path of its directory where that exists, so that a
+ * watcher can tell when it appears.
+ */
+static int Load(int n, Import &import) {
+    string path = (import.path[0] == '/' ? "" : files[n]->dir) + import.path;
+    char real[PATH_MAX];
+    bool found = (realpath(path.c_str(), real) != NULL);
+    if (found && numbers.count(real) > 0)
+        return numbers[real];
+
+    ProgramFile *f = new ProgramFile;
+    if (!found || !ReadFile(real, f->text)) {
+        delete f;
+        size_t slash = path.rfind('/');
+        string dir = (slash == string::npos ? "." : path.substr(0, slash + 1));
+        if (realpath(dir.c_str(), real) != NULL)
+            missing.push_back(string(real) + "/" + path.substr(slash + 1));
+        Diagnostics::SetFile(n);
+        ReportError::Formatted(&import.location,
+                               "Cannot open imported file %s", path.c_str());
+        return -1;
+    }
+    f->name = path;
+    f->dir = path.substr(0, path.rfind('/') + 1);
+    f->real = real;
+    numbers[real] = files.size();
+    files.push_back(f);
+    Parse(files.size() - 1);
+    return files.size() - 1;
+}
+
+/* Function: Order
+ * ---------------
+ * Appends file number n to order after the files it imports, unless it
+ * is there already. A file imported while its own imports are being
+ * walked closes a cycle, which is reported at that import.
+ */
+static void Order(int n, vector<int> &state, vector<int> &order) {
+    enum { Unvisited, Visiting, Ordered };
+    state[n] = Visiting;
+    ProgramFile *f = files[n];
+    for (size_t i = 0; i < f->dependencies.size(); i++) {
+        int m = f->dependencies[i];
+        if (state[m] == Visiting) {
+            Import &import = f->imports[f->via[i]];
+            Diagnostics::SetFile(n);
+            ReportError::Formatted(&import.location,
+                                   "Import of %s makes a cycle",
+                                   import.path.c_str());
+        } else if (state[m] == Unvisited)
+            Order(m, state, order);
+    }
+    state[n] = Ordered;
+    order.push_back(n);
+}
+
+/* Function: KeyChecks
+ * -------------------
+ * Works out the key of the checks of each file, for --incremental: the
+ * hash of its text and, for each file whose declarations it sees, the
+ * file's real path and the signatures of its declarations, along with
+ * those preloaded from a module. Errors in a file come from its own
+ * text, looked at in the light of the declarations it sees, so a file
+ * with the same key has the same errors. A file that sees one whose
+ * text cannot be split into declarations gets no key. Sets last for
+ * the files whose last check can be reused, unless the cross-reference
+ * index is written, which needs the checks done.
+ */
+static void KeyChecks(const vector<int> &order,
+                      const vector<vector<bool> > &sees) {
+    vector<unsigned long long> signatures(files.size());
+    for (size_t k = 0; k < order.size(); k++) {
+        ProgramFile *f = files[order[k]];
+        const char *text = (order[k] == 0 ? GetSourceText() : f->text.data());
+        size_t length = (order[k] == 0 ? GetSourceLength() : f->text.size());
+        signatures[order[k]] = HashSignatures(text, length, f->decls);
+    }
+    List<Decl*> *preloaded = Program::Preloaded();
+    const char *mode = (GetOption("signatures-only") ? "s" : "-");
+
+    for (size_t k = 0; k < order.size(); k++) {
+        int n = order[k];
+        ProgramFile *f = files[n];
+        Sha256 hash;
+        hash.Update(mode, 1);
+        if (n == 0)
+            hash.Update(GetSourceText(), GetSourceLength());
+        else
+            hash.Update(f->text.data(), f->text.size());
+        bool keyed = true;
+        for (size_t j = 0; j < order.size(); j++) {
+            int m = order[j];
+            if (!sees[n][m])
+                continue;
+            keyed = keyed && signatures[m] != 0;
+            hash.Update(files[m]->real.c_str(), files[m]->real.size() + 1);
+            hash.Update(&signatures[m], sizeof(signatures[m]));
+        }
+        for (int i = 0, num = preloaded->NumElements(); i < num; ++i) {
+            Decl *d = preloaded->Nth(i);
+            hash.Update(&d, sizeof(d));
+        }
+        f->checkKey = (keyed ? hash.HexDigest() : "");
+
+        unordered_map<string, CheckedFile>::iterator last =
+            lastChecks.find(f->real);
+        if (keyed && !writingXrefs && last != lastChecks.end() &&
+            last->second.key == f->checkKey)
+            f->last = &last->second;
+    }
+}
+
+// Reports the errors of the last check of file number n again
+static void Replay(int n) {
+    const vector<Diagnostic> &diagnostics = files[n]->last->diagnostics;
+    for (size_t i = 0; i < diagnostics.size(); i++) {
+        Diagnostic d = diagnostics[i];
+        d.file = n;
+        Diagnostics::Replay(d);
+    }
+}
+
+// Keeps what checking the files came to for the next compile, and
+// returns how many were not checked again
+static int KeepChecks(const vector<int> &order) {
+    int numReused = 0;
+    for (size_t k = 0; k < order.size(); k++) {
+        ProgramFile *f = files[order[k]];
+        if (f->last != NULL)
+            numReused++;
+        else if (!f->checkKey.empty()) {
+            CheckedFile &kept = lastChecks[f->real];
+            kept.key = f->checkKey;
+            kept.diagnostics.swap(f->diagnostics);
+        } else
+            lastChecks.erase(f->real);
+    }
+    return numReused;
+}
+
+// Takes files whose imports are checked and checks them, or reports the
+// errors of their last check again, until there are none left
+static void *CheckFiles(void *) {
+    pthread_mutex_lock(&queueLock);
+    for (;;) {
+        while (ready.empty() && numUnchecked > 0)
+            pthread_cond_wait(&queueChanged, &queueLock);
+        if (ready.empty())
+            break;
+        int n = ready.back();
+        ready.pop_back();
+        pthread_mutex_unlock(&queueLock);
+
+        ProgramFile *f = files[n];
+        Program::gScope = f->scope;
+        Diagnostics::SetThreadFile(n);
+        Diagnostics::SetOrderKey(f->key + 1);
+        if (f->last != NULL)
+            Replay(n);
+        else {
+            size_t numRecorded = Diagnostics::NumRecordedByThread();
+            for (int i = 0, num = f->decls->NumElements(); i < num; ++i)
+                f->decls->Nth(i)->Check();
+            if (!f->checkKey.empty())
+                Diagnostics::CopyRecordedSince(numRecorded, f->diagnostics);
+        }
+
+        pthread_mutex_lock(&queueLock);
+        numUnchecked--;
+        for (size_t i = 0; i < f->importers.size(); i++)
+            if (--waitingFor[f->importers[i]] == 0)
+                ready.push_back(f->importers[i]);
+        pthread_cond_broadcast(&queueChanged);
+    }
+    pthread_mutex_unlock(&queueLock);
+    return NULL;
+}
+
+/* Function: Declare
+ * -----------------
+ * Enters d, declared in file number n, into all, the table of the whole
+ * program, unless its name is taken, and returns whether it was. A name
+ * taken in another file is reported along with that file's name.
+ */
+static bool Declare(Scope *all, unordered_map<Decl*, int> &owners, Decl *d,
+                    int n) {
+    Decl *prev = all->table->Lookup(d->Name());
+    if (prev != NULL && owners[prev] != n) {
+        ReportError::Formatted(d->GetLocation(), "Declaration of '%s' here "
+                               "conflicts with declaration in %s line %d",
+                               d->Name(), files[owners[prev]]->name.c_str(),
+                               prev->GetLocation()->first_line);
+        return false;
+    }
+    if (all->AddDecl(d) != 0)
+        return false;
+    owners[d] = n;
+    return true;
+}
+
+/* Function: Check
+ * ---------------
+ * Checks the files, given in dependency order. First the scopes are
+ * set up, one file after another: each declaration is entered into a
+ * table of the whole program, which finds the names declared twice, and
+ * into the scope of its file, which also gets those of the files the
+ * file imports. The files are then checked on as many threads as
+ * --check-threads allows, the calling thread being one. With
+ * --incremental, and no errors so far, a file whose key is the same as
+ * at its last check is not checked again.
+ */
+static void Check(const vector<int> &order) {
+    int numErrors = ReportError::NumErrors();
+    Scope *global = Program::gScope;
+    Scope *all = new Scope;
+    all->preloaded = global->preloaded;
+    List<Decl*> *decls = new List<Decl*>;
+    vector<vector<Decl*> > entered(files.size());
+    vector<vector<bool> > sees(files.size());
+
+    for (size_t k = 0; k < order.size(); k++) {
+        int n = order[k];
+        ProgramFile *f = files[n];
+        f->key = FileKeys * (k + 1);
+        Diagnostics::SetFile(n);
+        Diagnostics::SetOrderKey(f->key);
+
+        sees[n].assign(files.size(), false);
+        for (size_t i = 0; i < f->dependencies.size(); i++) {
+            int m = f->dependencies[i];
+            sees[n][m] = true;
+            for (size_t j = 0; j < files.size(); j++)
+                if (sees[m][j])
+                    sees[n][j] = true;
+        }
+        f->scope = new Scope;
+        f->scope->preloaded = global->preloaded;
+        for (size_t j = 0; j < order.size(); j++)
+            for (size_t i = 0; sees[n][order[j]] &&
+                     i < entered[order[j]].size(); i++) {
+                Decl *d = entered[order[j]][i];
+                f->scope->table->Enter(d->Name(), d);
+            }
+
+        for (int i = 0, num = f->decls->NumElements(); i < num; ++i) {
+            Decl *d = f->decls->Nth(i);
+            decls->Append(d);
+            if (Declare(all, owners, d, n)) {
+                entered[n].push_back(d);
+                f->scope->table->Enter(d->Name(), d);
+            }
+        }
+        Program::gScope = f->scope;
+        for (int i = 0, num = f->decls->NumElements(); i < num; ++i)
+            f->decls->Nth(i)->BuildScope(f->scope);
+        Program::gScope = global;
+    }
+
+    bool incremental = (GetOption("incremental") != NULL &&
+                        ReportError::NumErrors() == numErrors);
+    if (incremental)
+        KeyChecks(order, sees);
+
+    ready.clear();
+    waitingFor.assign(files.size(), 0);
+    numUnchecked = order.size();
+    for (size_t k = order.size(); k-- > 0; ) {
+        int n = order[k];
+        waitingFor[n] = files[n]->dependencies.size();
+        if (waitingFor[n] == 0)
+            ready.push_back(n);
+    }
+
+    const char *threads = GetOption("check-threads");
+    int numThreads = (threads ? atoi(threads) : sysconf(_SC_NPROCESSORS_ONLN));
+    numThreads = max(1, min(numThreads, (int)order.size()));
+    PrintDebug("imports", "Checking %d files on %d threads",
+               (int)order.size(), numThreads);
+    vector<pthread_t> helpers(numThreads - 1);
+    for (size_t i = 0; i < helpers.size(); i++)
+        if (pthread_create(&helpers[i], NULL, CheckFiles, NULL) != 0)
+            Failure("Cannot create checking thread");
+    orderKeyT key = Diagnostics::GetOrderKey();
+    CheckFiles(NULL);
+    for (size_t i = 0; i < helpers.size(); i++)
+        pthread_join(helpers[i], NULL);
+
+    if (incremental)
+        PrintDebug("incremental", "Reused %d of %d files",
+                   KeepChecks(order), (int)order.size());
+    Program::gScope = global;
+    Diagnostics::SetThreadFile(-1);
+    Diagnostics::SetOrderKey(key);
+    Program::NoteChecked(decls, ReportError::NumErrors() - numErrors);
+}
+
+void CheckImports() {
+    // The dependency graph only ever has the units of one file
+    if (GetOption("invalidates"))
+        printf("Cannot tell what changing %s invalidates in a program of "
+               "several files\n", GetOption("invalidates"));
+
+    ProgramFile *first = files[0];
+    const char *text = GetSourceText();
+    size_t length = GetSourceLength();
+    first->lineStarts.swap(lineStarts);
+    orderKeyT key = Diagnostics::GetOrderKey();
+    int numErrors = ReportError::NumErrors();
+
+    for (size_t n = 0; n < files.size(); n++) {
+        ProgramFile *f = files[n];
+        for (size_t i = 0; i < f->imports.size(); i++) {
+            int m = Load(n, f->imports[i]);
+            if (m >= 0 &&
+                find(f->dependencies.begin(), f->dependencies.end(), m) ==
+                f->dependencies.end()) {
+                f->dependencies.push_back(m);
+                f->via.push_back(i);
+                files[m]->importers.push_back(n);
+            }
+        }
+    }
+    OpenSourceText(text, length);
+    lineStarts.swap(first->lineStarts);
+    Diagnostics::SetFile(0);
+    Diagnostics::SetOrderKey(key);
+
+    // Cycles are only looked for once every file has parsed, like any
+    // other semantic error
+    if (ReportError::NumErrors() > numErrors)
+        return;
+    for (size_t n = 0; n < files.size(); n++)
+        if (files[n]->decls == NULL)
+            return;
+    vector<int> state(files.size(), 0), order;
+    Order(0, state, order);
+    Diagnostics::SetFile(0);
+    if (ReportError::NumErrors() == numErrors)
+        Check(order);
+}
+
+void GetImportedPaths(vector<string> &paths) {
+    for (size_t n = 1; anyImports && n < files.size(); n++)
+        paths.push_back(files[n]->real);
+    paths.insert(paths.end(), missing.begin(), missing.end());
+}
+
+const char *GetFileName(int n) {
+    return (anyImports ? files[n]->name.c_str() : NULL);
+}
+
+int GetDeclFile(Decl *decl) {
+    Node *top = decl;
+    while (top->GetParent() != NULL &&
+           dynamic_cast<Program*>(top->GetParent()) == NULL)
+        top = top->GetParent();
+    if (top->GetParent() == NULL)
+        return -1;
+    if (!anyImports)
+        return 0;
+    unordered_map<Decl*, int>::iterator i = owners.find((Decl*)top);
+    return (i != owners.end() ? i->second : -1);
+}
+
+const char *GetFileLine(int n, int num, size_t *length) {
+    if (!anyImports || n == 0)
+        return GetLineNumbered(num, length);
+
+    const vector<size_t> &starts = files[n]->lineStarts;
+    const string &text = files[n]->text;
+    if (num <= 0 || (size_t)num > starts.size())
+        return NULL;
+    size_t start = starts[num - 1];
+    size_t end = ((size_t)num < starts.size() ? starts[num] - 1
+                                             : text.size());
+    if (start == text.size())
+        return NULL;
+    if ((size_t)num == starts.size()) {
+        size_t newline = text.find('\n', start);
+        if (newline != string::npos)
+            end = newline;
+    }
+    *length = end - start;
+    return text.data() + start;
+}
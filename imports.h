@@ -0,0 +1,89 @@
+/* File: imports.h
+ * ---------------
+ * Programs of several files. A file may begin with directives
+ *
+ *    import "shapes.decaf";
+ *
+ * naming other files, relative to its own directory, whose top-level
+ * declarations it can then use as if they were its own, along with
+ * those of the files they import in turn. Each file, however many
+ * others import it, is read and parsed once. A file that imports
+ * another, directly or not, cannot be imported by it. The word import
+ * is not reserved: the parsers take an identifier followed by a string
+ * at the top of a file for a directive, and only then want it to be
+ * import, so the name is still free for declarations.
+ *
+ * The parser notes each import and, rather than checking a file right
+ * away, leaves its declarations to CheckImports(), which loads and
+ * parses the files imported until it has them all. The top-level names
+ * of all the files share one namespace, so a name declared twice is an
+ * error even in files that do not see each other. Each file's scope
+ * holds its own declarations and those of the files it imports, and
+ * the files are checked in that scope in dependency order: a file as
+ * soon as those it imports are done, on as many threads as
+ * --check-threads=N allows (by default one per processor), so that files
+ * that do not depend on one another are checked at the same time. Errors
+ * are ordered as if the files had been checked one after another, those
+ * imported first, and name the file they are in.
+ *
+ * With --incremental, a process that compiles the program again, like a
+ * worker of the compile server, checks again only the files that have
+ * changed or that see a declaration whose signature or position has:
+ * each file's errors are kept, keyed by its text and the signatures of
+ * the files it imports, directly or not, and reported again while the
+ * key stays the same. Every file is still parsed and its scope built.
+ * Streaming and the caches only ever deal with programs of one file; a
+ * program of several is never streamed, and neither its tree nor its
+ * result is saved. Nor is its dependency graph recorded, so all that
+ * --invalidates says of it is that it cannot tell.
+ */
+
+#ifndef _H_imports
+#define _H_imports
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "list.h"
+#include "location.h"
+
+class Decl;
+
+// Starts a compile of the source opened by OpenSource(), from the file
+// at path, or standard input if path is NULL
+void BeginImports(const char *path);
+
+// Notes a directive importing the file named by the string constant at
+// loc, quotes and all, into the file being parsed
+void NoteImport(const char *quoted, yyltype *loc);
+
+// Returns whether the program has files other than the one it began
+// with, as far as the parse has got
+bool HasImports();
+
+// Keeps the declarations of the file just parsed, to be checked with
+// the rest of the program, and returns true if it is one of several;
+// returns false if the file is the whole program
+bool DeferCheck(List<Decl*> *decls);
+
+// Loads the files imported, and those they import, and checks them all,
+// for a program whose first file has been parsed and has imports
+void CheckImports();
+
+// Adds to paths the real path of every file the program imports,
+// directly or not, and the path of each import that could not be read,
+// for a caller that compiles it again when one of them changes
+void GetImportedPaths(std::vector<std::string> &paths);
+
+// Returns the name of file number n of the program, the first file
+// being 0, or NULL if the program has only the one file
+const char *GetFileName(int n);
+
+// Returns the number of the file that decl is declared in, or -1 if it
+// is in none of them, like a declaration of a module
+int GetDeclFile(Decl *decl);
+
+// Like GetLineNumbered(), for line num of file number n
+const char *GetFileLine(int n, int num, size_t *length);
+
+#endif
@@ -0,0 +1,483 @@
+/* File: incremental.cc
+ * --------------------
+ * Implementation of incremental checking. The text of each declaration
+ * is found by a pass over the source that only follows braces, comments
+ * and strings: the program parsed without errors, so each top-level
+ * declaration ends at a ';' or at the '}' that closes its outermost
+ * brace, and each member of a class likewise one brace further in.
+ */
+
+#include "incremental.h"
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast_decl.h"
+#include "ast_stmt.h"
+#include "dependencies.h"
+#include "diagnostics.h"
+#include "source.h"
+#include "utility.h"
+#include "xref.h"
+using namespace std;
+
+typedef unsigned long long hashT;
+
+/* Struct: Span
+ * ------------
+ * Where the text of a declaration is: from its first character up to
+ * its last, the lines these are on and where the first line starts. The
+ * text from the start of that line on is what a unit is keyed by, as it
+ * decides the columns as well as the tokens. For a top-level
+ * declaration, bodies lists the function bodies that its signature
+ * leaves out.
+ */
+struct Span
+{
+    size_t lineStart, start, end;
+    int firstLine, lastLine;
+    vector<pair<size_t, size_t> > bodies;
+};
+
+struct Dependency
+{
+    const char *name;           // interned, see intern.h
+    hashT found;                // hash of what it stood for, 0 if nothing
+};
+
+/* Struct: CheckedUnit
+ * -------------------
+ * What checking a unit came to: the errors reported, located as they
+ * were at the time, and what the unit depended on.
+ */
+struct CheckedUnit
+{
+    hashT key;                  // hash of the unit's text and context
+    bool exact;                 // depends on whole texts and positions
+    int firstLine;
+    vector<Dependency> dependencies;
+    vector<Diagnostic> diagnostics;
+};
+
+// The units of the last incremental check of each input, by key
+typedef unordered_multimap<hashT, CheckedUnit> UnitTable;
+static unordered_map<string, UnitTable> lastChecks;
+
+// What a top-level declaration stands for, to units that depend on it
+struct DeclHashes
+{
+    hashT signature, exact;
+};
+static unordered_map<Decl*, DeclHashes> declHashes;
+
+static const hashT HashBasis = 14695981039346656037ULL;    // FNV-1a
+static const hashT HashPrime = 1099511628211ULL;
+
+
+static hashT Hash(const char *text, size_t length, hashT h) {
+    for (size_t i = 0; i < length; i++)
+        h = (h ^ (unsigned char)text[i]) * HashPrime;
+    return h;
+}
+
+static hashT Hash(hashT value, hashT h) {
+    return Hash((const char *)&value, sizeof(value), h);
+}
+
+static void Open(Span &span, size_t lineStart, size_t start, int line) {
+    span.lineStart = lineStart;
+    span.start = start;
+    span.firstLine = line;
+}
+
+static void Close(Span &span, size_t end, int line) {
+    span.end = end;
+    span.lastLine = line;
+}
+
+// Returns the index of the ';' that ends the import directive at i (see
+// imports.h), or i if there is none there
+static size_t SkipImport(const char *text, size_t length, size_t i) {
+    size_t j = i + 6;
+    if (length - i < 6 || strncmp(text + i, "import", 6) != 0)
+        return i;
+    while (j < length && isspace(text[j]))
+        j++;
+    if (j == length || text[j] != '"')
+        return i;
+    for (j++; j < length && text[j] != '"' && text[j] != '\n'; j++)
+        ;
+    for (j++; j < length && isspace(text[j]); j++)
+        ;
+    return (j < length && text[j] == ';' ? j : i);
+}
+
+/* Function: FindSpans
+ * -------------------
+ * Finds the span of each declaration in decls, and of each member of
+ * those that are classes, in the text they were parsed from, past any
+ * import directives. Returns false if the text does not split into as
+ * many as there are, which it always should.
+ */
+static bool FindSpans(const char *text, size_t length, List<Decl*> *decls,
+                      vector<Span> &spans,
+                      vector<vector<Span> > &memberSpans) {
+    int numDecls = decls->NumElements();
+    spans.assign(numDecls, Span());
+    memberSpans.assign(numDecls, vector<Span>());
+
+    int line = 1, depth = 0, bodyDepth = INT_MAX;
+    int numSpans = 0;
+    size_t lineStart = 0, bodyStart = 0;
+    Span *decl = NULL, *member = NULL;
+    ClassDecl *classDecl = NULL;
+
+    for (size_t i = 0; i < length; i++) {
+        char c = text[i];
+        char next = (i + 1 < length ? text[i + 1] : '\0');
+        if (c == '\n') {
+            line++;
+            lineStart = i + 1;
+            continue;
+        }
+        if (isspace(c))
+            continue;
+        if (c == '/' && next == '/') {
+            while (i + 1 < length && text[i + 1] != '\n')
+                i++;
+            continue;
+        }
+        if (c == '/' && next == '*') {
+            for (i += 2; i + 1 < length; i++) {
+                if (text[i] == '*' && text[i + 1] == '/')
+                    break;
+                if (text[i] == '\n') {
+                    line++;
+                    lineStart = i + 1;
+                }
+            }
+            i++;
+            continue;
+        }
+
+        if (decl == NULL && numSpans == 0 && SkipImport(text, length, i) > i) {
+            i = SkipImport(text, length, i);
+            continue;
+        }
+        if (decl == NULL) {
+            if (depth != 0 || numSpans == numDecls)
+                return false;
+            Decl *d = decls->Nth(numSpans);
+            classDecl = dynamic_cast<ClassDecl*>(d);
+            bodyDepth = (classDecl != NULL ? 2 :
+                         dynamic_cast<FnDecl*>(d) != NULL ? 1 : INT_MAX);
+            decl = &spans[numSpans++];
+            Open(*decl, lineStart, i, line);
+        } else if (classDecl != NULL && depth == 1 && member == NULL &&
+                   c != '}') {
+            vector<Span> &members = memberSpans[numSpans - 1];
+            members.push_back(Span());
+            member = &members.back();
+            Open(*member, lineStart, i, line);
+        }
+
+        if (c == '"') {
+            while (i + 1 < length && text[i + 1] != '"' &&
+                   text[i + 1] != '\n')
+                i++;
+            if (i + 1 < length && text[i + 1] == '"')
+                i++;
+        } else if (c == '{') {
+            if (++depth == bodyDepth)
+                bodyStart = i + 1;
+        } else if (c == '}' || c == ';') {
+            if (c == '}' && depth-- == bodyDepth)
+                decl->bodies.push_back(make_pair(bodyStart, i));
+            if (depth < 0)
+                return false;
+            if (depth == 1 && member != NULL) {
+                Close(*member, i + 1, line);
+                member = NULL;
+            } else if (depth == 0) {
+                Close(*decl, i + 1, line);
+                decl = NULL;
+            }
+        }
+    }
+
+    if (decl != NULL || numSpans != numDecls)
+        return false;
+    for (int i = 0; i < numDecls; i++) {
+        ClassDecl *c = dynamic_cast<ClassDecl*>(decls->Nth(i));
+        if (c != NULL &&
+            (int)memberSpans[i].size() != c->GetMembers()->NumElements())
+            return false;
+    }
+    return true;
+}
+
+// Returns the hash of the unit whose text is in span, in the context
+// the seed stands for
+static hashT UnitKey(const Span &span, hashT seed) {
+    const char *text = GetSourceText();
+    return Hash(text + span.lineStart, span.end - span.lineStart, seed);
+}
+
+static void HashDecl(Decl *decl, const Span &span, hashT seed) {
+    const char *text = GetSourceText();
+    DeclHashes &h = declHashes[decl];
+
+    h.signature = seed;
+    size_t from = span.start;
+    for (size_t i = 0; i < span.bodies.size(); i++) {
+        h.signature = Hash(text + from, span.bodies[i].first - from,
+                           h.signature);
+        from = span.bodies[i].second;
+    }
+    h.signature = Hash(text + from, span.end - from, h.signature);
+    h.exact = Hash(span.firstLine, UnitKey(span, seed));
+}
+
+// Hashes the declarations preloaded from a module (see module.h), which
+// were not parsed from the source. They stay the same objects for as
+// long as the module is loaded, and are never freed, so what they stand
+// for is where they are.
+static void HashPreloaded(hashT seed) {
+    List<Decl*> *preloaded = Program::Preloaded();
+    for (int i = 0, n = preloaded->NumElements(); i < n; ++i) {
+        Decl *decl = preloaded->Nth(i);
+        DeclHashes &h = declHashes[decl];
+        h.signature = h.exact = Hash((hashT)(uintptr_t)decl, seed);
+    }
+}
+
+// Returns the hash of what a lookup found, for a unit that depends on
+// exact positions or not, or 0 if it found nothing
+static hashT Found(Decl *decl, bool exact) {
+    if (decl == NULL)
+        return 0;
+    unordered_map<Decl*, DeclHashes>::iterator h = declHashes.find(decl);
+    Assert(h != declHashes.end());
+    return (exact ? h->second.exact : h->second.signature);
+}
+
+static bool StillHolds(const CheckedUnit &unit) {
+    for (size_t i = 0; i < unit.dependencies.size(); i++) {
+        const Dependency &d = unit.dependencies[i];
+        if (Found(Program::gScope->Lookup(d.name), unit.exact) != d.found)
+            return false;
+    }
+    return true;
+}
+
+static bool ByName(const pair<const char*, Decl*> &a,
+                   const pair<const char*, Decl*> &b) {
+    return a.first < b.first;
+}
+
+static bool SameName(const pair<const char*, Decl*> &a,
+                     const pair<const char*, Decl*> &b) {
+    return a.first == b.first;
+}
+
+/* Struct: Unit
+ * ------------
+ * A unit to check: decl, or if inheritance is set, the class decl as a
+ * whole. When checking incrementally, also its span, its key and
+ * whether it depends on whole texts and positions.
+ */
+struct Unit
+{
+    Decl *decl;
+    bool inheritance;
+    const Span *span;
+    hashT key;
+    bool exact;
+};
+
+// The units of the last and of this check of the input, when checking
+// incrementally
+static UnitTable *lastUnits = NULL, *nextUnits = NULL;
+static int numReused;
+
+/* Function: Reuse
+ * ---------------
+ * Looks for a unit of the last check with the same key as u whose
+ * dependencies still hold. If there is one, its errors are reported
+ * again and it is kept for the next check. Returns whether there was.
+ */
+static bool Reuse(const Unit &u, int node) {
+    pair<UnitTable::iterator, UnitTable::iterator> same =
+        lastUnits->equal_range(u.key);
+    for (UnitTable::iterator i = same.first; i != same.second; ++i) {
+        CheckedUnit &unit = i->second;
+        if (unit.exact != u.exact || !StillHolds(unit))
+            continue;
+
+        int shift = u.span->firstLine - unit.firstLine;
+        unit.firstLine = u.span->firstLine;
+        for (size_t j = 0; j < unit.diagnostics.size(); j++) {
+            Diagnostic &d = unit.diagnostics[j];
+            if (d.hasLocation) {
+                d.location.first_line += shift;
+                d.location.last_line += shift;
+            }
+            Diagnostics::Replay(d);
+        }
+        for (size_t j = 0; j < unit.dependencies.size(); j++)
+            DependencyGraph::AddDependency(node, unit.dependencies[j].name);
+        nextUnits->insert(lastUnits->extract(i));
+        return true;
+    }
+    return false;
+}
+
+/* Function: CheckUnit
+ * -------------------
+ * Checks one unit, recording what it depends on in the dependency graph
+ * and, when checking incrementally, keeping the outcome for the next
+ * check unless the last one can be reused instead. Nothing is reused
+ * while the cross-reference index is written, as it would miss the
+ * declarations and uses of the unit.
+ */
+static void CheckUnit(const Unit &u) {
+    int node = DependencyGraph::AddUnit(u.decl, u.inheritance);
+    if (lastUnits != NULL && !writingXrefs && Reuse(u, node)) {
+        numReused++;
+        return;
+    }
+
+    vector<pair<const char*, Decl*> > lookups;
+    size_t numRecorded = Diagnostics::NumRecordedByThread();
+    Scope::globalLookups = &lookups;
+    if (u.inheritance)
+        static_cast<ClassDecl*>(u.decl)->CheckInheritance();
+    else
+        u.decl->Check();
+    Scope::globalLookups = NULL;
+
+    sort(lookups.begin(), lookups.end(), ByName);
+    lookups.erase(unique(lookups.begin(), lookups.end(), SameName),
+                  lookups.end());
+    for (size_t i = 0; i < lookups.size(); i++)
+        DependencyGraph::AddDependency(node, lookups[i].first);
+    if (nextUnits == NULL)
+        return;
+
+    CheckedUnit unit;
+    unit.key = u.key;
+    unit.exact = u.exact;
+    unit.firstLine = u.span->firstLine;
+    Diagnostics::CopyRecordedSince(numRecorded, unit.diagnostics);
+
+    // Errors are moved along with the unit, so those outside it, if
+    // there were any, could not be
+    for (size_t i = 0; i < unit.diagnostics.size(); i++) {
+        const Diagnostic &d = unit.diagnostics[i];
+        if (d.hasLocation && (d.location.first_line < u.span->firstLine ||
+                              d.location.last_line > u.span->lastLine))
+            return;
+    }
+
+    for (size_t i = 0; i < lookups.size(); i++) {
+        Dependency d = { lookups[i].first, Found(lookups[i].second,
+                                                 u.exact) };
+        unit.dependencies.push_back(d);
+    }
+    nextUnits->emplace(u.key, move(unit));
+}
+
+void CheckUnits(List<Decl*> *decls) {
+    int n = decls->NumElements();
+    vector<Span> spans;
+    vector<vector<Span> > memberSpans;
+    bool incremental = (GetOption("incremental") != NULL);
+    if (incremental && !FindSpans(GetSourceText(), GetSourceLength(), decls,
+                                  spans, memberSpans)) {
+        PrintDebug("incremental", "Cannot split the source");
+        incremental = false;
+    }
+
+    // Units of different kinds are told apart by their seeds, as are
+    // the results of compiling with and without --signatures-only
+    hashT seed = Hash(GetOption("signatures-only") != NULL, HashBasis);
+    hashT declSeed = Hash(1, seed), classSeed = Hash(3, seed);
+
+    UnitTable units;
+    if (incremental) {
+        for (int i = 0; i < n; ++i)
+            HashDecl(decls->Nth(i), spans[i], seed);
+        HashPreloaded(seed);
+        const char *input = GetInputFile();
+        lastUnits = &lastChecks[input != NULL ? input : "-"];
+        nextUnits = &units;
+    }
+
+    DependencyGraph::Clear();
+    int numUnits = 0;
+    numReused = 0;
+    for (int i = 0; i < n; ++i) {
+        Unit u = { decls->Nth(i), false, NULL, 0, false };
+        ClassDecl *c = dynamic_cast<ClassDecl*>(u.decl);
+        if (c == NULL) {
+            if (incremental) {
+                u.span = &spans[i];
+                u.key = UnitKey(spans[i], declSeed);
+            }
+            CheckUnit(u);
+            numUnits++;
+            continue;
+        }
+
+        hashT memberSeed = 0;
+        if (incremental)
+            memberSeed = Hash(declHashes[c].signature, Hash(2, seed));
+        List<Decl*> *members = c->GetMembers();
+        for (int j = 0, m = members->NumElements(); j < m; ++j) {
+            Unit member = { members->Nth(j), false, NULL, 0, false };
+            if (incremental) {
+                member.span = &memberSpans[i][j];
+                member.key = UnitKey(memberSpans[i][j], memberSeed);
+            }
+            CheckUnit(member);
+        }
+        u.inheritance = u.exact = true;
+        if (incremental) {
+            u.span = &spans[i];
+            u.key = UnitKey(spans[i], classSeed);
+        }
+        CheckUnit(u);
+        numUnits += members->NumElements() + 1;
+    }
+
+    if (incremental) {
+        lastUnits->swap(units);
+        PrintDebug("incremental", "Reused %d of %d checks", numReused,
+                   numUnits);
+    }
+    lastUnits = nextUnits = NULL;
+    declHashes.clear();
+}
+
+unsigned long long HashSignatures(const char *text, size_t length,
+                                  List<Decl*> *decls) {
+    vector<Span> spans;
+    vector<vector<Span> > memberSpans;
+    if (!FindSpans(text, length, decls, spans, memberSpans))
+        return 0;
+    hashT h = HashBasis;
+    size_t from = 0;
+    for (size_t i = 0; i < spans.size(); i++)
+        for (size_t j = 0; j < spans[i].bodies.size(); j++) {
+            size_t start = spans[i].bodies[j].first;
+            size_t end = spans[i].bodies[j].second;
+            h = Hash(text + from, start - from, h);
+            h = Hash((hashT)count(text + start, text + end, '\n'), h);
+            from = end;
+        }
+    return Hash(text + from, length - from, h);
+}
@@ -0,0 +1,50 @@
+/* File: incremental.h
+ * -------------------
+ * Incremental checking (--incremental), for a process that compiles one
+ * version of a program after another, like a worker of the compile
+ * server (see server.h). The semantic checks are split into units: each
+ * top-level declaration other than a class is one, and a class is one
+ * per member plus one for the class as a whole (see CheckInheritance in
+ * ast_decl.h). The errors each unit reports are kept along with what
+ * they depended on: the unit's own text, and for each name the unit
+ * looked up in the global scope, the declaration the name stood for.
+ * When the same input is compiled again, a unit with the same text whose
+ * names still stand for the same declarations is not checked again.
+ * Its errors are reported again instead, moved to where its text is now,
+ * so the output is the same as that of a full check.
+ *
+ * What a name stands for is the text of its declaration without the
+ * bodies of functions. Editing a method body re-checks that method and
+ * nothing else, while editing a signature re-checks everything that
+ * looked the class up as well. A member also depends on the signature of
+ * its own class. The checks of a class as a whole report the lines of
+ * members of other classes, so for them a name stands for the whole text
+ * and position of its declaration.
+ *
+ * The program is still scanned and parsed in full, and all its scopes
+ * are built, so that every node has its current location; it is the
+ * checks, the bulk of the work, that are skipped.
+ */
+
+#ifndef _H_incremental
+#define _H_incremental
+
+#include <stddef.h>
+#include "list.h"
+
+class Decl;
+
+// Checks the top-level declarations of a program, whose scopes have
+// been built, unit by unit, recording the dependency graph (see
+// dependencies.h). With --incremental, the results of the last check of
+// the same input are reused where they still hold.
+void CheckUnits(List<Decl*> *decls);
+
+// Returns a hash of text, from which decls were parsed, that leaves out
+// the function bodies but not the lines they take up: it changes with
+// the signatures of the declarations and where they are, and not with
+// what the functions do. Returns 0 if the text cannot be split.
+unsigned long long HashSignatures(const char *text, size_t length,
+                                  List<Decl*> *decls);
+
+#endif
@@ -0,0 +1,122 @@
+/* File: intern.cc
+ * ---------------
+ * Implementation of the identifier table. Each shard is an open
+ * addressing hash table of names, kept at most half full, with the names
+ * themselves stored back to back in large blocks that are never freed.
+ */
+
+#include "intern.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utility.h"
+
+static const int ShardBits = 4;
+static const int NumShards = 1 << ShardBits;
+static const size_t InitialSlots = 256;      // per shard, a power of 2
+static const size_t BlockSize = 1 << 16;
+
+struct Slot
+{
+    unsigned int hash;
+    unsigned int length;
+    const char *name;           // NULL if the slot is free
+};
+
+/* Struct: Shard
+ * -------------
+ * One part of the table, holding the names whose hash has the shard's
+ * number in its top bits; the low bits pick the slot.
+ */
+struct Shard
+{
+    pthread_mutex_t lock;
+    Slot *slots;
+    size_t numSlots, numNames;
+    char *block;                // where the next name goes
+    size_t blockLeft;
+} __attribute__((aligned(64)));
+
+static Shard shards[NumShards];
+static pthread_once_t initOnce = PTHREAD_ONCE_INIT;
+
+static void InitShards() {
+    for (int i = 0; i < NumShards; i++) {
+        Shard *s = &shards[i];
+        pthread_mutex_init(&s->lock, NULL);
+        s->slots = (Slot *)calloc(InitialSlots, sizeof(Slot));
+        s->numSlots = InitialSlots;
+        s->numNames = 0;
+        s->block = NULL;
+        s->blockLeft = 0;
+    }
+}
+
+unsigned int HashName(const char *text, size_t length) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        h = (h ^ (unsigned char)text[i]) * 16777619u;
+    return h;
+}
+
+/* Function: Store
+ * ---------------
+ * Copies a name into the shard's current block, starting a new block
+ * when it does not fit.
+ */
+static const char *Store(Shard *s, const char *text, size_t length) {
+    if (length + 1 > s->blockLeft) {
+        size_t size = (length + 1 > BlockSize ? length + 1 : BlockSize);
+        if ((s->block = (char *)malloc(size)) == NULL)
+            Failure("Out of memory for identifiers");
+        s->blockLeft = size;
+    }
+    char *name = s->block;
+    memcpy(name, text, length);
+    name[length] = '\0';
+    s->block += length + 1;
+    s->blockLeft -= length + 1;
+    return name;
+}
+
+static void Grow(Shard *s) {
+    size_t numSlots = 2 * s->numSlots;
+    Slot *slots = (Slot *)calloc(numSlots, sizeof(Slot));
+    if (slots == NULL)
+        Failure("Out of memory for identifiers");
+    for (size_t i = 0; i < s->numSlots; i++) {
+        if (s->slots[i].name == NULL)
+            continue;
+        size_t j = s->slots[i].hash & (numSlots - 1);
+        while (slots[j].name != NULL)
+            j = (j + 1) & (numSlots - 1);
+        slots[j] = s->slots[i];
+    }
+    free(s->slots);
+    s->slots = slots;
+    s->numSlots = numSlots;
+}
+
+const char *Intern(const char *text, size_t length, unsigned int hash) {
+    pthread_once(&initOnce, InitShards);
+    Shard *s = &shards[hash >> (32 - ShardBits)];
+
+    pthread_mutex_lock(&s->lock);
+    size_t i = hash & (s->numSlots - 1);
+    for (; s->slots[i].name != NULL; i = (i + 1) & (s->numSlots - 1)) {
+        Slot *slot = &s->slots[i];
+        if (slot->hash == hash && slot->length == length &&
+            memcmp(slot->name, text, length) == 0) {
+            pthread_mutex_unlock(&s->lock);
+            return slot->name;
+        }
+    }
+    const char *name = Store(s, text, length);
+    s->slots[i].hash = hash;
+    s->slots[i].length = length;
+    s->slots[i].name = name;
+    if (++s->numNames > s->numSlots / 2)
+        Grow(s);
+    pthread_mutex_unlock(&s->lock);
+    return name;
+}
@@ -0,0 +1,27 @@
+/* File: intern.h
+ * --------------
+ * The identifier table. The scanners intern every identifier they match
+ * and hand the parser the interned name, a pointer that stays valid for
+ * the rest of the run. Equal names intern to the same pointer, so the
+ * semantic value of an identifier token is pointer-sized and identifiers
+ * can be compared without looking at their characters.
+ *
+ * Interning may happen on several scanning threads at once (--pipeline,
+ * --chunked). The table is split into shards by hash, each with a lock
+ * of its own, so threads rarely wait on each other.
+ */
+
+#ifndef _H_intern
+#define _H_intern
+
+#include <stddef.h>
+
+// Returns the hash that Intern expects for the given text, which need
+// not be NUL-terminated.
+unsigned int HashName(const char *text, size_t length);
+
+// Returns the interned copy of the given text, NUL-terminated, adding it
+// to the table if it is not there yet. hash must be HashName of the text.
+const char *Intern(const char *text, size_t length, unsigned int hash);
+
+#endif
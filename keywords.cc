@@ -0,0 +1,95 @@
+/* File: keywords.cc
+ * -----------------
+ * Implementation of the keyword table. Everything up to LookupKeyword is
+ * evaluated by the compiler; the static_assert below fails the build if
+ * no seed can be found.
+ */
+
+#include "keywords.h"
+#include <string.h>
+#include "parser.h" // for token codes
+
+struct Keyword
+{
+    const char *name;
+    size_t length;
+    int code;
+};
+
+#define KEYWORD(name, code) { name, sizeof(name) - 1, code }
+
+static constexpr Keyword keywords[] = {
+    KEYWORD("void", T_Void),           KEYWORD("int", T_Int),
+    KEYWORD("double", T_Double),       KEYWORD("bool", T_Bool),
+    KEYWORD("string", T_String),       KEYWORD("null", T_Null),
+    KEYWORD("class", T_Class),         KEYWORD("extends", T_Extends),
+    KEYWORD("this", T_This),           KEYWORD("interface", T_Interface),
+    KEYWORD("implements", T_Implements), KEYWORD("while", T_While),
+    KEYWORD("for", T_For),             KEYWORD("if", T_If),
+    KEYWORD("else", T_Else),           KEYWORD("return", T_Return),
+    KEYWORD("break", T_Break),         KEYWORD("new", T_New),
+    KEYWORD("NewArray", T_NewArray),   KEYWORD("Print", T_Print),
+    KEYWORD("ReadInteger", T_ReadInteger), KEYWORD("ReadLine", T_ReadLine),
+    KEYWORD("true", T_BoolConstant),   KEYWORD("false", T_BoolConstant),
+};
+
+static const int NumKeywords = sizeof(keywords) / sizeof(keywords[0]);
+static const size_t MaxKeywordLength = 11; // ReadInteger
+static const int TableBits = 6;
+static const int TableSize = 1 << TableBits;
+
+/* Function: Hash
+ * --------------
+ * FNV-1a style hash over the length and the first, middle and last
+ * characters, which already tell all keywords apart; the seed is what
+ * makes it perfect. Returns a slot index.
+ */
+static constexpr unsigned int Hash(const char *text, size_t length,
+                                   unsigned int seed) {
+    unsigned int h = seed ^ (unsigned int)length;
+    h = (h ^ (unsigned char)text[0]) * 16777619u;
+    h = (h ^ (unsigned char)text[length / 2]) * 16777619u;
+    h = (h ^ (unsigned char)text[length - 1]) * 16777619u;
+    return h >> (32 - TableBits);
+}
+
+static constexpr bool IsPerfect(unsigned int seed) {
+    bool used[TableSize] = {};
+    for (int i = 0; i < NumKeywords; i++) {
+        unsigned int slot = Hash(keywords[i].name, keywords[i].length, seed);
+        if (used[slot])
+            return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+struct KeywordTable
+{
+    unsigned int seed;
+    signed char slots[TableSize]; // index into keywords, or -1
+};
+
+static constexpr KeywordTable BuildTable() {
+    KeywordTable table = {};
+    while (!IsPerfect(table.seed))
+        table.seed++;
+    for (int i = 0; i < TableSize; i++)
+        table.slots[i] = -1;
+    for (int i = 0; i < NumKeywords; i++)
+        table.slots[Hash(keywords[i].name, keywords[i].length, table.seed)] = i;
+    return table;
+}
+
+static constexpr KeywordTable table = BuildTable();
+static_assert(IsPerfect(table.seed), "keyword hash is not perfect");
+
+int LookupKeyword(const char *text, size_t length) {
+    if (length == 0 || length > MaxKeywordLength)
+        return 0;
+    int k = table.slots[Hash(text, length, table.seed)];
+    if (k < 0 || keywords[k].length != length ||
+        memcmp(keywords[k].name, text, length) != 0)
+        return 0;
+    return keywords[k].code;
+}
@@ -0,0 +1,21 @@
+/* File: keywords.h
+ * ----------------
+ * Classification of identifiers as keywords. The scanners match every
+ * word with a single identifier pattern and then look it up here, which
+ * keeps the flex DFA small. The lookup goes through a perfect hash table
+ * that is built by the compiler: the hash function's seed is searched
+ * for at compile time until all keywords land in different slots, so a
+ * lookup costs one hash and at most one comparison.
+ */
+
+#ifndef _H_keywords
+#define _H_keywords
+
+#include <stddef.h>
+
+// Returns the token code of the keyword spelled by the given text, which
+// need not be NUL-terminated, or 0 if it is not a keyword. The literals
+// true and false count as keywords with code T_BoolConstant.
+int LookupKeyword(const char *text, size_t length);
+
+#endif
@@ -0,0 +1,39 @@
+/* File: literals.cc
+ * -----------------
+ * Implementation of the literal decoder, on top of std::from_chars.
+ */
+
+#include "literals.h"
+#include <charconv>
+#include <string>
+#include "errors.h"
+
+int DecodeInteger(const char *text, size_t length, int base, yyltype *loc) {
+    const char *end = text + length;
+    std::from_chars_result result;
+    int value;
+
+    if (base == 16) {
+        unsigned int bits;
+        result = std::from_chars(text + 2, end, bits, 16);
+        value = (int)bits;
+    } else
+        result = std::from_chars(text, end, value, 10);
+
+    if (result.ec == std::errc::result_out_of_range) {
+        ReportError::IntegerOutOfRange(loc, string(text, length).c_str());
+        return 0;
+    }
+    return value;
+}
+
+double DecodeDouble(const char *text, size_t length, yyltype *loc) {
+    double value;
+    std::from_chars_result result = std::from_chars(text, text + length,
+                                                    value);
+    if (result.ec == std::errc::result_out_of_range) {
+        ReportError::DoubleOutOfRange(loc, string(text, length).c_str());
+        return 0;
+    }
+    return value;
+}
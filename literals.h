@@ -0,0 +1,25 @@
+/* File: literals.h
+ * ----------------
+ * Decoding of numeric literals. The scanners have already checked the
+ * syntax of a literal by the time they get here, so the decoder works
+ * straight on the matched text, without copying it, without a NUL
+ * terminator and without regard to the locale. A literal whose value
+ * does not fit its type is reported as an error and decodes as 0.
+ */
+
+#ifndef _H_literals
+#define _H_literals
+
+#include <stddef.h>
+#include "location.h"
+
+// Decodes an integer literal matching INTEGER (base 10) or HEX_INTEGER
+// (base 16, including its 0x prefix). Decimal literals must fit an int;
+// hexadecimal ones may use all 32 bits, so 0xFFFFFFFF is -1.
+int DecodeInteger(const char *text, size_t length, int base, yyltype *loc);
+
+// Decodes a literal matching DOUBLE. Values too large or too small to
+// be represented other than as infinity or 0 are out of range.
+double DecodeDouble(const char *text, size_t length, yyltype *loc);
+
+#endif
@@ -24,6 +24,10 @@ typedef struct yyltype
 
 #define YYLTYPE yyltype
 
+// yyltype is plain data, which allows the parser to grow its stacks by
+// copying them (see YYMAXDEPTH in parser.y).
+#define YYLTYPE_IS_TRIVIAL 1
+
 
 /* Global variable: yylloc
  * ------------------------
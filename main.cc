@@ -9,22 +9,106 @@
 #include "utility.h"
 #include "errors.h"
 #include "parser.h"
+#include "token_stream.h"
+#include "source.h"
+#include "rd_parser.h"
+#include "server.h"
+#include "watch.h"
+#include "cache.h"
+#include "ast_cache.h"
+#include "module.h"
+#include "imports.h"
+#include "position_index.h"
+#include "xref.h"
 
 
+/* Function: Compile
+ * -----------------
+ * Compiles the source opened by OpenSource(), leaving the errors found
+ * recorded, and returns the exit status for them. InitScanner() is used
+ * to set up the scanner. InitParser() is used to set up the parser.
+ * InitTokenStream() connects the two, starting a scanner thread if the
+ * scanner is to run ahead of the parser. The call to yyparse() will
+ * attempt to parse a complete program from the input, or ParseStream()
+ * when streaming, which parses the input as it arrives;
+ * ParseRecursiveDescent() does the same job as yyparse() with the
+ * hand-written parser. With --ast-cache, a tree saved by an earlier
+ * compile of the same source takes the place of all of that, and a tree
+ * parsed without errors is saved for the next (see ast_cache.h). The
+ * declarations of a module given with --module are in scope before any
+ * of it, and --emit-module makes a module of the result (see module.h).
+ * A source that imports others is checked along with them once they are
+ * loaded (see imports.h). Queries by position (--at) are answered from
+ * the nodes noted while the source is parsed (see position_index.h),
+ * and --xref writes out the declarations and uses the checks come across
+ * (see xref.h).
+ */
+int Compile()
+{
+    BeginImports(GetInputFile());
+    BeginXrefs();
+    if (GetOption("module"))
+        PreloadModule();
+
+    BeginPositionIndex();
+    if (!GetOption("ast-cache") || !LoadCachedAst()) {
+        InitScanner();
+        InitParser();
+        InitTokenStream();
+        if (GetOption("stream"))
+            ParseStream();
+        else if (GetOption("rd-parse"))
+            ParseRecursiveDescent();
+        else
+            yyparse();
+        FinishTokenStream();
+        if (HasImports())
+            CheckImports();
+        if (GetOption("ast-cache"))
+            SaveCachedAst();
+    }
+    EndPositionIndex();
+
+    if (GetOption("emit-module"))
+        EmitModule();
+    if (GetOption("at"))
+        AnswerPositionQueries();
+    EndXrefs();
+    return (ReportError::NumErrors() == 0? 0 : -1);
+}
+
 /* Function: main()
  * ----------------
  * Entry point to the entire program.  We parse the command line and turn
  * on any debugging flags requested by the user when invoking the program.
- * InitScanner() is used to set up the scanner.
- * InitParser() is used to set up the parser. The call to yyparse() will
- * attempt to parse a complete program from the input. 
+ * With --serve, dcc becomes a compile server, and with --client it hands
+ * its work to one (see server.h), and with --watch it checks a directory
+ * of files over and over as they change (see watch.h). Otherwise
+ * OpenSource() gets hold of the source, from the file named on the
+ * command line if any, and it is compiled, or its result is taken from
+ * the cache if there is one (see cache.h). Errors are collected along
+ * the way and written out together at the end.
  */
 int main(int argc, char *argv[])
 {
     ParseCommandLine(argc, argv);
-    InitScanner();
-    InitParser();
-    yyparse();
-    return (ReportError::NumErrors() == 0? 0 : -1);
-}
+    if (GetOption("serve"))
+        return Serve(GetOption("serve"));
+    if (GetOption("client"))
+        return RunClient(GetOption("client"), argc, argv);
+    if (GetOption("watch")) {
+        const char *dir = GetOption("watch");
+        if (*dir == '\0' && (dir = GetInputFile()) == NULL)
+            Failure("No directory to watch");
+        return Watch(dir, argv);
+    }
+    if (GetOption("cache-stats"))
+        return PrintCacheStats();
 
+    OpenSource(GetInputFile());
+    if (CacheDirectory() != NULL)
+        return CompileCached(argc, argv);
+    int status = Compile();
+    ReportError::Flush();
+    return status;
+}
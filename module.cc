@@ -0,0 +1,109 @@
+/* File: module.cc
+ * ---------------
+ * Implementation of precompiled modules. The module loaded last is kept,
+ * along with what its file looked like then, so that it can be entered
+ * into the global scope of each compile without reading it again.
+ */
+
+#include "module.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "ast_cache.h"
+#include "ast_decl.h"
+#include "ast_stmt.h"
+#include "cache.h"              // for BuildId
+#include "errors.h"
+#include "sha256.h"
+#include "utility.h"
+using namespace std;
+
+struct Module
+{
+    string path;
+    struct stat file;           // when it was loaded
+    List<Decl*> *decls;
+};
+
+static Module loaded;
+
+
+// Returns the key that modules are written under, which only a module
+// written by this build of dcc has
+static string ModuleKey() {
+    Sha256 hash;
+    string id = BuildId();
+    hash.Update(id.data(), id.size());
+    hash.Update("module", 6);
+    return hash.HexDigest();
+}
+
+static bool SameFile(const struct stat &a, const struct stat &b) {
+    return (a.st_dev == b.st_dev && a.st_ino == b.st_ino &&
+            a.st_size == b.st_size &&
+            a.st_mtim.tv_sec == b.st_mtim.tv_sec &&
+            a.st_mtim.tv_nsec == b.st_mtim.tv_nsec);
+}
+
+/* Function: Load
+ * --------------
+ * Reads the module at path, unless it is the one loaded already, and
+ * builds the scopes of its declarations, once; the global scope they
+ * are built in is the one of every later compile (see Program::Reset).
+ */
+static List<Decl*> *Load(const char *path) {
+    struct stat file;
+    if (stat(path, &file) != 0)
+        Failure("Cannot open module %s", path);
+    if (loaded.decls != NULL && loaded.path == path &&
+        SameFile(loaded.file, file))
+        return loaded.decls;
+
+    List<Decl*> *decls = ReadAstFile(path, ModuleKey(), NULL);
+    if (decls == NULL)
+        Failure("%s is not a module of this build of dcc", path);
+    for (int i = 0, n = decls->NumElements(); i < n; ++i)
+        decls->Nth(i)->BuildScope(Program::gScope);
+    PrintDebug("module", "Loaded %d declarations from %s",
+               decls->NumElements(), path);
+
+    loaded.path = path;
+    loaded.file = file;
+    loaded.decls = decls;
+    return decls;
+}
+
+void PreloadModule() {
+    const char *path = GetOption("module");
+    if (path != NULL)
+        Program::Preload(Load(path));
+}
+
+void EmitModule() {
+    const char *path = GetOption("emit-module");
+    List<Decl*> *decls = Program::Declarations();
+    if (path == NULL || decls == NULL || ReportError::NumErrors() > 0)
+        return;
+
+    AstWriter writer(false);
+    writer.WriteList(decls);
+    if (!WriteAstFile(path, writer.Contents(ModuleKey(), vector<size_t>())))
+        Failure("Cannot write module %s", path);
+    PrintDebug("module", "Wrote %d declarations to %s",
+               decls->NumElements(), path);
+}
+
+string ModuleDigest() {
+    const char *path = GetOption("module");
+    int fd = (path != NULL ? open(path, O_RDONLY) : -1);
+    if (fd < 0)
+        return "";
+    Sha256 hash;
+    char buffer[65536];
+    for (ssize_t n; (n = read(fd, buffer, sizeof(buffer))) > 0; )
+        hash.Update(buffer, n);
+    close(fd);
+    return hash.HexDigest();
+}
@@ -0,0 +1,39 @@
+/* File: module.h
+ * --------------
+ * Precompiled modules, for class libraries that many programs share.
+ * Compiling the library with --emit-module=file checks it as usual and,
+ * if it has no errors, writes its declarations to file: classes,
+ * interfaces, functions and global variables, with function bodies left
+ * out. A program compiled with --module=file is then checked as if the
+ * library came before it in the same source, except that the library is
+ * neither parsed nor checked again: the module is mapped into memory,
+ * its declarations are built from it and entered into the global scope,
+ * with the member tables of its classes and interfaces, before the
+ * program is parsed.
+ *
+ * A module is written in the form of the AST cache (see ast_cache.h),
+ * under a key that only a module written by the same build of dcc
+ * matches. A module emitted while another is preloaded holds the
+ * declarations of both. A process that compiles many programs, like a
+ * compile server, loads a module once, and again only when its file
+ * changes.
+ */
+
+#ifndef _H_module
+#define _H_module
+
+#include <string>
+
+// Enters the declarations of the module given with --module into the
+// global scope, loading it first if need be
+void PreloadModule();
+
+// Writes the module asked for by --emit-module, for a compile that found
+// no errors
+void EmitModule();
+
+// Returns the SHA-256 of the module given with --module, for keys that
+// must change with it
+std::string ModuleDigest();
+
+#endif
@@ -5,24 +5,36 @@
 
 %{
 
+#include <string.h>
 #include "scanner.h" // for yylex
 #include "parser.h"
 #include "errors.h"
+#include "imports.h"
 
 void yyerror(const char *msg); // standard error-handling routine
 
+// The parser stacks start out small and double in size as needed, up to
+// this many entries (--max-parse-depth=N).
+int MaxParseDepth();
+#define YYMAXDEPTH MaxParseDepth()
+
 %}
 
  
 /* yylval 
  * ------
  */
+/* Besides yyparse(), which pulls tokens through yylex(), generate the
+ * push parser that streaming mode (--stream) hands one token at a time.
+ */
+%define api.push-pull both
+
 %union {
     int integerConstant;
     bool boolConstant;
     char *stringConstant;
     double doubleConstant;
-    char identifier[MaxIdentLen+1]; // +1 for terminating null
+    const char *identifier; // interned, see intern.h
     Decl *decl;
     List<Decl*> *declList;
     Type *type;
@@ -47,6 +59,7 @@ void yyerror(const char *msg); // standard error-handling routine
 %token   T_And T_Or T_Null T_Extends T_This T_Interface T_Implements
 %token   T_While T_For T_If T_Else T_Return T_Break
 %token   T_New T_NewArray T_Print T_ReadInteger T_ReadLine
+%token   T_FnBody         /* a whole function body, see SkipBody() */
 
 %token   <identifier> T_Identifier
 %token   <stringConstant> T_StringConstant 
@@ -95,18 +108,35 @@ void yyerror(const char *msg); // standard error-handling routine
  * -----
 	 
  */
-Program   :    DeclList            { 
+Program   :    Imports DeclList    { 
                                       @1; 
-                                      Program *program = new Program($1);
+                                      Program *program = new Program($2);
                                       // if no errors, advance to next phase
-                                      if (ReportError::NumErrors() == 0) 
+                                      if (Program::NumParseErrors() == 0) 
                                           program->Check(); 
                                     }
           ;
 
 
-DeclList  :    DeclList Decl        { ($$=$1)->Append($2); }
-          |    Decl                 { ($$ = new List<Decl*>)->Append($1); }
+Imports   :    Imports Import
+          |    /* empty */
+          ;
+
+/* import is not a keyword, so that it stays free for names elsewhere:
+ * a directive is an identifier followed by a string, which nothing else
+ * is, and only that identifier has to be import.
+ */
+Import    :    T_Identifier T_StringConstant ';'
+                                    { if (strcmp($1, "import") != 0) {
+                                          yylloc = @2;
+                                          yyerror("syntax error");
+                                          YYABORT;
+                                      }
+                                      NoteImport($2, &@2); }
+          ;
+
+DeclList  :    DeclList Decl        { ($$=$1)->Append($2); Program::Declare($2); }
+          |    Decl                 { ($$ = new List<Decl*>)->Append($1); Program::Declare($1); }
           ;
 
 Decl      :    ClassDecl
@@ -182,18 +212,26 @@ FormalList:    FormalList ',' Variable
           ;
 
 FnDecl    :    FnHeader StmtBlock   { ($$=$1)->SetFunctionBody($2); }
+          |    FnHeader T_FnBody    { $$=$1; }
           ;
 
 StmtBlock :    '{' VarDecls StmtList '}' 
                                     { $$ = new StmtBlock($2, $3); }
+          |    '{' VarDecls '}'     { $$ = new StmtBlock($2, new List<Stmt*>); }
           ;
 
 VarDecls  :    VarDecls VarDecl     { ($$=$1)->Append($2); }
           |    /* empty */          { $$ = new List<VarDecl*>; }
           ;
 
-StmtList  :    Stmt StmtList        { $$ = $2; $$->InsertAt($1, 0); }
-          |    /* empty */          { $$ = new List<Stmt*>; }
+/* StmtList is left-recursive so that each statement is reduced into the
+ * list as soon as it is complete, which keeps the parser stack as shallow
+ * as the nesting of the block however many statements it has. It cannot
+ * be empty: reducing an empty list ahead of the first statement would
+ * mean telling a statement from a declaration by its first token alone.
+ */
+StmtList  :    StmtList Stmt        { ($$=$1)->Append($2); }
+          |    Stmt                 { ($$ = new List<Stmt*>)->Append($1); }
           ;
 
 Stmt      :    OptExpr ';'          { $$ = $1; }
@@ -302,3 +340,15 @@ void InitParser()
    PrintDebug("parser", "Initializing parser");
    yydebug = false;
 }
+
+/* Function: MaxParseDepth
+ * -----------------------
+ * Returns the limit on the depth of the parser stacks, past which the
+ * parse fails with "memory exhausted". Lists do not nest, so only deeply
+ * nested statements and expressions get anywhere near the default.
+ */
+int MaxParseDepth()
+{
+   const char *depth = GetOption("max-parse-depth");
+   return (depth ? atoi(depth) : 10000);
+}
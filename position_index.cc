@@ -0,0 +1,223 @@
+/* File: position_index.cc
+ * -----------------------
+ * Implementation of position queries. The nodes are noted in the order
+ * they are built and only sorted, once, when the first query comes.
+ */
+
+#include "position_index.h"
+#include <cxxabi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#include "ast_decl.h"
+#include "ast_expr.h"
+#include "ast_stmt.h"
+#include "ast_type.h"
+#include "imports.h"
+#include "utility.h"
+using namespace std;
+
+struct Position
+{
+    int line, column;
+};
+
+// A node along with its location and the order it was built in, so that
+// sorting need not look at the node itself
+struct IndexedNode
+{
+    int firstLine, firstColumn, lastLine, lastColumn;
+    int built;
+    Node *node;
+
+    bool operator<(const IndexedNode &other) const;
+};
+
+bool indexingPositions = false;
+static vector<IndexedNode> nodes;
+static bool sorted;
+static vector<Position> queries;
+
+
+// Reads the positions of --at=L:C,L:C,...
+static void ReadQueries(const char *at) {
+    queries.clear();
+    for (const char *p = at; *p != '\0'; ) {
+        Position query;
+        int length;
+        if (sscanf(p, "%d:%d%n", &query.line, &query.column, &length) != 2 ||
+            (p[length] != ',' && p[length] != '\0'))
+            Failure("Bad position in --at=%s; use --at=line:column", at);
+        queries.push_back(query);
+        p += length + (p[length] == ',');
+    }
+}
+
+void BeginPositionIndex() {
+    const char *at = GetOption("at");
+    nodes.clear();
+    sorted = false;
+    if (at != NULL)
+        ReadQueries(at);
+    indexingPositions = (at != NULL);
+}
+
+void EndPositionIndex() {
+    indexingPositions = false;
+}
+
+void NotePosition(Node *node) {
+    yyltype *loc = node->GetLocation();
+    IndexedNode entry = { loc->first_line, loc->first_column, loc->last_line,
+                          loc->last_column, (int)nodes.size(), node };
+    nodes.push_back(entry);
+}
+
+static bool StartsAfter(yyltype *loc, int line, int column) {
+    return (loc->first_line > line ||
+            (loc->first_line == line && loc->first_column > column));
+}
+
+static bool EndsBefore(yyltype *loc, int line, int column) {
+    return (loc->last_line < line ||
+            (loc->last_line == line && loc->last_column < column));
+}
+
+// Orders nodes by where they start and, of those that start together,
+// those that end later first, so that a node comes before those inside,
+// and of those with the same location, those built later first
+bool IndexedNode::operator<(const IndexedNode &other) const {
+    if (firstLine != other.firstLine)
+        return firstLine < other.firstLine;
+    if (firstColumn != other.firstColumn)
+        return firstColumn < other.firstColumn;
+    if (lastLine != other.lastLine)
+        return lastLine > other.lastLine;
+    if (lastColumn != other.lastColumn)
+        return lastColumn > other.lastColumn;
+    return built > other.built;
+}
+
+static bool Detached(const IndexedNode &entry) {
+    return entry.node->GetParent() == NULL;
+}
+
+/* Function: Find
+ * --------------
+ * Returns the innermost node whose location holds the position, or NULL.
+ * The last node to start at or before it is either that node or inside
+ * it, unless there is none, so it is found by walking up from there.
+ * Nodes without a parent, which the checks make for the types they work
+ * out, are dropped first; the tree has no others.
+ */
+static Node *Find(int line, int column) {
+    if (!sorted) {
+        nodes.erase(remove_if(nodes.begin(), nodes.end(), Detached),
+                    nodes.end());
+        sort(nodes.begin(), nodes.end());
+        sorted = true;
+    }
+    int low = 0, high = nodes.size();
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (nodes[mid].firstLine > line ||
+            (nodes[mid].firstLine == line && nodes[mid].firstColumn > column))
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    for (Node *n = (low > 0 ? nodes[low - 1].node : NULL); n != NULL;
+         n = n->GetParent()) {
+        yyltype *loc = n->GetLocation();
+        if (loc != NULL && !StartsAfter(loc, line, column) &&
+            !EndsBefore(loc, line, column))
+            return n;
+    }
+    return NULL;
+}
+
+static string Kind(Node *node) {
+    const char *name = typeid(*node).name();
+    int status;
+    char *demangled = abi::__cxa_demangle(name, NULL, NULL, &status);
+    string kind = (status == 0 ? demangled : name);
+    free(demangled);
+    return kind;
+}
+
+// Returns the type of what the node stands for, or NULL if it has none
+static Type *TypeOf(Node *node) {
+    if (Identifier *id = dynamic_cast<Identifier*>(node))
+        return (id->GetParent() != NULL ? TypeOf(id->GetParent()) : NULL);
+    if (Type *t = dynamic_cast<Type*>(node))
+        return t;
+    if (Expr *e = dynamic_cast<Expr*>(node))
+        return e->GetType();
+    if (VarDecl *d = dynamic_cast<VarDecl*>(node))
+        return d->GetType();
+    if (FnDecl *d = dynamic_cast<FnDecl*>(node))
+        return d->GetReturnType();
+    if (ClassDecl *d = dynamic_cast<ClassDecl*>(node))
+        return d->GetType();
+    if (InterfaceDecl *d = dynamic_cast<InterfaceDecl*>(node))
+        return d->GetType();
+    return NULL;
+}
+
+// Returns the scope of the file that the node is in, where the names it
+// uses are looked up, or NULL if the node is in no declaration
+static Scope *FileScope(Node *node) {
+    Decl *d = NULL;
+    for (Node *n = node; n != NULL && d == NULL; n = n->GetParent())
+        d = dynamic_cast<Decl*>(n);
+    Scope *s = (d != NULL ? d->GetScope() : NULL);
+    while (s != NULL && s->GetParent() != NULL)
+        s = s->GetParent();
+    return s;
+}
+
+static string Answer(int line, int column) {
+    ostringstream out;
+    out << line << ":" << column << ": ";
+    Node *node = Find(line, column);
+    if (node == NULL)
+        return out.str() + "nothing";
+
+    yyltype *loc = node->GetLocation();
+    out << Kind(node) << " " << loc->first_line << ":" << loc->first_column
+        << "-" << loc->last_line << ":" << loc->last_column;
+
+    Scope *global = Program::gScope, *scope = FileScope(node);
+    if (scope != NULL)
+        Program::gScope = scope;
+    if (Decl *d = node->GetDecl()) {
+        out << " decl " << Kind(d) << " " << d->Name() << " ";
+        int file = GetDeclFile(d);
+        if (file >= 0 && GetFileName(file) != NULL)
+            out << GetFileName(file) << ":";
+        out << d->GetLocation()->first_line << ":"
+            << d->GetLocation()->first_column;
+    }
+    if (Type *t = TypeOf(node))
+        out << " type " << t;
+    Program::gScope = global;
+    return out.str();
+}
+
+void AnswerPositionQueries() {
+    if (GetOption("at") == NULL)
+        return;
+    bool checked = (Program::Declarations() != NULL);
+    for (size_t i = 0; i < queries.size(); i++) {
+        const Position &q = queries[i];
+        if (checked)
+            printf("%s\n", Answer(q.line, q.column).c_str());
+        else
+            printf("%d:%d: nothing\n", q.line, q.column);
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,50 @@
+/* File: position_index.h
+ * ----------------------
+ * Queries by source position, for editors: what is at line L, column C,
+ * the declaration it names, for going to the definition, and its type.
+ * With --at=L:C (or several, as --at=L:C,L:C,...) each node with a
+ * location is noted as the parser builds it, and once the program is
+ * checked, the answers are written out, one line per query:
+ *
+ *    L:C: Kind first-last [decl Kind name line:column] [type T]
+ *
+ * or "L:C: nothing" if no node is there, or the program was not checked
+ * because of syntax errors. The node is the innermost one whose location
+ * holds the position, e.g. the name in a call rather than the call, and
+ * first-last its location as line:column pairs.
+ *
+ * The index is the nodes sorted by where they start, later ones first
+ * among those with the same location, as a node is built after its
+ * children. A query is a binary search for the last node that starts
+ * at or before the position, then a walk up its parents to the first
+ * whose location holds the position, so it takes time logarithmic in
+ * the size of the tree and linear in its depth. Only the nodes of the
+ * source itself are noted, not those of imported files or modules.
+ *
+ * A compile server answers queries too (see server.h), so that an
+ * editor can keep one running with --incremental and ask it about the
+ * buffer it has open.
+ */
+
+#ifndef _H_position_index
+#define _H_position_index
+
+class Node;
+
+// Whether nodes are being noted, which is only while the source is
+// parsed, or its tree loaded, and there are queries
+extern bool indexingPositions;
+
+// Starts a new index for the source about to be parsed, if there are
+// queries (--at), and notes each node built until EndPositionIndex()
+void BeginPositionIndex();
+void EndPositionIndex();
+
+// Notes a node that has just been built with a location
+void NotePosition(Node *node);
+
+// Writes the answers to the queries to stdout, each of them nothing if
+// the program has not been checked
+void AnswerPositionQueries();
+
+#endif
@@ -0,0 +1,700 @@
+/* File: rd_parser.cc
+ * ------------------
+ * Implementation of the hand-written parser. Each Parse function covers
+ * one or more nonterminals of parser.y, whose rules and actions it
+ * mirrors; the grammar there remains the reference.
+ *
+ * A syntax error is reported through yyerror() at the offending token
+ * and then unwinds the whole parse with longjmp(), as no error recovery
+ * is attempted. The parse functions therefore hold nothing that needs
+ * cleaning up.
+ */
+
+#include "rd_parser.h"
+#include <setjmp.h>
+#include <sys/resource.h>
+#include "imports.h"
+#include "parser.h"
+#include "token_stream.h"       // for Token
+
+void yyerror(const char *msg);  // Defined in errors.cc
+int MaxParseDepth();            // Defined in parser.y
+
+/* Binary operator precedences, loosest first, as declared in parser.y.
+ * Assignment is not among them: its left side must be an LValue, so it
+ * is handled on its own (see ParseSubexpr).
+ */
+enum { OrPrec = 1, AndPrec, EqualityPrec, RelationalPrec, AdditivePrec,
+       MultiplicativePrec, UnaryPrec };
+
+static Token lookahead[2];      // lookahead[0] is the next token
+static int numLookahead;
+static int depth, maxDepth;
+static char *stackBase;         // roughly where the parse began
+static size_t stackBudget;      // how much further down it may go
+static jmp_buf abortParse;
+
+static Stmt *ParseStmt();
+static StmtBlock *ParseStmtBlock();
+static Expr *ParseExpr(yyltype *loc);
+
+
+static void Read(Token *token) {
+    token->code = yylex();
+    token->value = yylval;
+    token->location = yylloc;
+}
+
+/* Function: Peek
+ * --------------
+ * Returns the code of the next token, reading it if not yet read.
+ */
+static int Peek() {
+    if (numLookahead == 0) {
+        Read(&lookahead[0]);
+        numLookahead = 1;
+    }
+    return lookahead[0].code;
+}
+
+// Returns the code of the token after the next one
+static int PeekSecond() {
+    Peek();
+    if (numLookahead == 1) {
+        Read(&lookahead[1]);
+        numLookahead = 2;
+    }
+    return lookahead[1].code;
+}
+
+/* Function: Shift
+ * ---------------
+ * Consumes the next token and returns its location. Its value, if it has
+ * one, must be taken from lookahead[0] beforehand. The parse functions
+ * keep only locations and nodes, rather than whole Tokens, so that their
+ * frames and the stack depth per level of nesting stay small.
+ */
+static yyltype Shift() {
+    Peek();
+    yyltype loc = lookahead[0].location;
+    lookahead[0] = lookahead[1];
+    numLookahead--;
+    return loc;
+}
+
+// Reports an error at the next token, which bison would have just read
+static void Fail(const char *msg) {
+    if (numLookahead > 0)
+        yylloc = lookahead[0].location;
+    yyerror(msg);
+    longjmp(abortParse, 1);
+}
+
+static yyltype Expect(int code) {
+    if (Peek() != code)
+        Fail("syntax error");
+    return Shift();
+}
+
+static Identifier *ExpectIdentifier() {
+    if (Peek() != T_Identifier)
+        Fail("syntax error");
+    const char *name = lookahead[0].value.identifier;
+    return new Identifier(Shift(), name);
+}
+
+/* Function: Enter/Leave
+ * ---------------------
+ * Bracket each statement and expression, to keep the nesting within
+ * --max-parse-depth, and the stack within half its limit so that the
+ * parse fails cleanly rather than overflowing it, and Check() has the
+ * other half.
+ */
+static void Enter() {
+    char here;
+    if (++depth > maxDepth || (size_t)(stackBase - &here) > stackBudget)
+        Fail("memory exhausted");
+}
+
+static void Leave() {
+    depth--;
+}
+
+static bool IsTypeStart(int code) {
+    return code == T_Int || code == T_Bool || code == T_String ||
+        code == T_Double || code == T_Identifier;
+}
+
+
+/* Type : T_Int | T_Bool | T_String | T_Double | T_Identifier
+ *      | Type T_Dims
+ */
+static Type *ParseType(yyltype *loc) {
+    Type *type;
+    if (Peek() == T_Identifier) {
+        Identifier *name = ExpectIdentifier();
+        *loc = *name->GetLocation();
+        type = new NamedType(name);
+    } else {
+        switch (Peek()) {
+          case T_Int:    type = Type::intType; break;
+          case T_Bool:   type = Type::boolType; break;
+          case T_String: type = Type::stringType; break;
+          case T_Double: type = Type::doubleType; break;
+          default:       Fail("syntax error"); return NULL;
+        }
+        *loc = Shift();
+    }
+    while (Peek() == T_Dims) {
+        *loc = Join(*loc, Shift());
+        type = new ArrayType(*loc, type);
+    }
+    return type;
+}
+
+/* Variable : Type T_Identifier
+ */
+static VarDecl *ParseVariable() {
+    yyltype loc;
+    Type *type = ParseType(&loc);
+    return new VarDecl(ExpectIdentifier(), type);
+}
+
+/* FnHeader : Type T_Identifier '(' Formals ')'
+ *          | T_Void T_Identifier '(' Formals ')'
+ * The caller has already parsed the return type and the name.
+ */
+static FnDecl *ParseFnHeader(Type *returnType, Identifier *name) {
+    Expect('(');
+    List<VarDecl*> *formals = new List<VarDecl*>;
+    if (Peek() != ')') {
+        formals->Append(ParseVariable());
+        while (Peek() == ',') {
+            Shift();
+            formals->Append(ParseVariable());
+        }
+    }
+    Expect(')');
+    return new FnDecl(name, returnType, formals);
+}
+
+// The return type of a FnHeader, or the Type of a Variable
+static Type *ParseReturnType() {
+    yyltype loc;
+    if (Peek() != T_Void)
+        return ParseType(&loc);
+    Shift();
+    return Type::voidType;
+}
+
+/* VarDecl : Variable ';'
+ * FnDecl  : FnHeader StmtBlock | FnHeader T_FnBody
+ * A Field of a class, and all other Decls but classes and interfaces.
+ */
+static Decl *ParseVarOrFnDecl() {
+    Type *type = ParseReturnType();
+    Identifier *name = ExpectIdentifier();
+    if (type != Type::voidType && Peek() == ';') {
+        Shift();
+        return new VarDecl(name, type);
+    }
+    FnDecl *fn = ParseFnHeader(type, name);
+    if (Peek() == T_FnBody)
+        Shift();
+    else
+        fn->SetFunctionBody(ParseStmtBlock());
+    return fn;
+}
+
+/* IntfDecl : T_Interface T_Identifier '{' IntfList '}'
+ * IntfList : IntfList FnHeader ';' | empty
+ */
+static Decl *ParseIntfDecl() {
+    Shift();
+    Identifier *name = ExpectIdentifier();
+    Expect('{');
+    List<Decl*> *members = new List<Decl*>();
+    while (Peek() != '}') {
+        Type *returnType = ParseReturnType();
+        members->Append(ParseFnHeader(returnType, ExpectIdentifier()));
+        Expect(';');
+    }
+    Shift();
+    return new InterfaceDecl(name, members);
+}
+
+/* ClassDecl : T_Class T_Identifier OptExt OptImpl '{' FieldList '}'
+ * OptExt    : T_Extends T_Identifier | empty
+ * OptImpl   : T_Implements ImpList | empty
+ */
+static Decl *ParseClassDecl() {
+    Shift();
+    Identifier *name = ExpectIdentifier();
+    NamedType *extends = NULL;
+    if (Peek() == T_Extends) {
+        Shift();
+        extends = new NamedType(ExpectIdentifier());
+    }
+    List<NamedType*> *implements = new List<NamedType*>;
+    if (Peek() == T_Implements) {
+        do {
+            Shift();
+            implements->Append(new NamedType(ExpectIdentifier()));
+        } while (Peek() == ',');
+    }
+    Expect('{');
+    List<Decl*> *fields = new List<Decl*>();
+    while (Peek() != '}')
+        fields->Append(ParseVarOrFnDecl());
+    Shift();
+    return new ClassDecl(name, extends, implements, fields);
+}
+
+static bool IsDeclStart(int code) {
+    return code == T_Class || code == T_Interface || code == T_Void ||
+        IsTypeStart(code);
+}
+
+static Decl *ParseDecl() {
+    switch (Peek()) {
+      case T_Class:     return ParseClassDecl();
+      case T_Interface: return ParseIntfDecl();
+      default:          return ParseVarOrFnDecl();
+    }
+}
+
+
+/* StmtBlock : '{' VarDecls StmtList '}' | '{' VarDecls '}'
+ * The declarations end at the first token that cannot start a Type, or
+ * at an identifier not followed by another or by T_Dims, which is where
+ * bison decides the same.
+ */
+static StmtBlock *ParseStmtBlock() {
+    Expect('{');
+    List<VarDecl*> *decls = new List<VarDecl*>;
+    while (IsTypeStart(Peek())) {
+        if (Peek() == T_Identifier && PeekSecond() != T_Identifier &&
+            PeekSecond() != T_Dims)
+            break;
+        decls->Append(ParseVariable());
+        Expect(';');
+    }
+    List<Stmt*> *stmts = new List<Stmt*>;
+    while (Peek() != '}')
+        stmts->Append(ParseStmt());
+    Shift();
+    return new StmtBlock(decls, stmts);
+}
+
+/* OptExpr : Expr | empty
+ * where the empty alternative is followed by the given token.
+ */
+static Expr *ParseOptExpr(int follow) {
+    yyltype loc;
+    if (Peek() == follow)
+        return new EmptyExpr();
+    return ParseExpr(&loc);
+}
+
+/* ExprList : ExprList ',' Expr | Expr
+ */
+static List<Expr*> *ParseExprList() {
+    List<Expr*> *list = new List<Expr*>;
+    yyltype loc;
+    list->Append(ParseExpr(&loc));
+    while (Peek() == ',') {
+        Shift();
+        list->Append(ParseExpr(&loc));
+    }
+    return list;
+}
+
+// '(' Expr ')', the test of an if or while
+static Expr *ParseTest() {
+    yyltype loc;
+    Expect('(');
+    Expr *test = ParseExpr(&loc);
+    Expect(')');
+    return test;
+}
+
+/* T_If '(' Expr ')' Stmt OptElse
+ * OptElse : T_Else Stmt | empty
+ * An else goes with the nearest if, as bison shifts it by preference.
+ */
+static Stmt *ParseIfStmt() {
+    Shift();
+    Expr *test = ParseTest();
+    Stmt *body = ParseStmt(), *elseBody = NULL;
+    if (Peek() == T_Else) {
+        Shift();
+        elseBody = ParseStmt();
+    }
+    return new IfStmt(test, body, elseBody);
+}
+
+/* T_While '(' Expr ')' Stmt
+ */
+static Stmt *ParseWhileStmt() {
+    Shift();
+    Expr *test = ParseTest();
+    return new WhileStmt(test, ParseStmt());
+}
+
+/* T_For '(' OptExpr ';' Expr ';' OptExpr ')' Stmt
+ */
+static Stmt *ParseForStmt() {
+    yyltype loc;
+    Shift();
+    Expect('(');
+    Expr *init = ParseOptExpr(';');
+    Expect(';');
+    Expr *test = ParseExpr(&loc);
+    Expect(';');
+    Expr *step = ParseOptExpr(')');
+    Expect(')');
+    return new ForStmt(init, test, step, ParseStmt());
+}
+
+/* T_Return Expr ';' | T_Return ';'
+ */
+static Stmt *ParseReturnStmt() {
+    yyltype loc = Shift();
+    Expr *expr;
+    if (Peek() == ';')
+        expr = new EmptyExpr();
+    else
+        expr = ParseExpr(&loc);
+    Expect(';');
+    return new ReturnStmt(loc, expr);
+}
+
+/* T_Print '(' ExprList ')' ';'
+ */
+static Stmt *ParsePrintStmt() {
+    Shift();
+    Expect('(');
+    List<Expr*> *args = ParseExprList();
+    Expect(')');
+    Expect(';');
+    return new PrintStmt(args);
+}
+
+/* Stmt : OptExpr ';' | StmtBlock | T_If ... | T_While ... | T_For ...
+ *      | T_Return ... | T_Print ... | T_Break ';'
+ */
+static Stmt *ParseStmt() {
+    Enter();
+    Stmt *stmt;
+    switch (Peek()) {
+      case '{':      stmt = ParseStmtBlock(); break;
+      case T_If:     stmt = ParseIfStmt(); break;
+      case T_While:  stmt = ParseWhileStmt(); break;
+      case T_For:    stmt = ParseForStmt(); break;
+      case T_Return: stmt = ParseReturnStmt(); break;
+      case T_Print:  stmt = ParsePrintStmt(); break;
+      case T_Break:
+        stmt = new BreakStmt(Shift());
+        Expect(';');
+        break;
+      default:
+        stmt = ParseOptExpr(';');
+        Expect(';');
+        break;
+    }
+    Leave();
+    return stmt;
+}
+
+
+/* Actuals : ExprList | empty
+ * followed by the closing ')', whose location is returned.
+ */
+static List<Expr*> *ParseActuals(yyltype *closeLoc) {
+    List<Expr*> *actuals;
+    if (Peek() == ')')
+        actuals = new List<Expr*>;
+    else
+        actuals = ParseExprList();
+    *closeLoc = Expect(')');
+    return actuals;
+}
+
+static Expr *ParseSubexpr(int minPrec, yyltype *loc);
+
+/* Function: ParseConstant
+ * -----------------------
+ * Constant : T_IntConstant | T_BoolConstant | T_DoubleConstant
+ *          | T_StringConstant | T_Null
+ */
+static Expr *ParseConstant(yyltype *loc) {
+    int code = Peek();
+    YYSTYPE value = lookahead[0].value;
+    *loc = Shift();
+    switch (code) {
+      case T_IntConstant:
+        return new IntConstant(*loc, value.integerConstant);
+      case T_BoolConstant:
+        return new BoolConstant(*loc, value.boolConstant);
+      case T_DoubleConstant:
+        return new DoubleConstant(*loc, value.doubleConstant);
+      case T_StringConstant:
+        return new StringConstant(*loc, value.stringConstant);
+      default:
+        return new NullConstant(*loc);
+    }
+}
+
+/* Function: ParseKeywordExpr
+ * --------------------------
+ * T_ReadInteger '(' ')' | T_ReadLine '(' ')' | T_New T_Identifier
+ * | T_NewArray '(' Expr ',' Type ')' | T_This
+ */
+static Expr *ParseKeywordExpr(yyltype *loc) {
+    int code = Peek();
+    *loc = Shift();
+    if (code == T_This)
+        return new This(*loc);
+    if (code == T_New) {
+        Identifier *name = ExpectIdentifier();
+        *loc = Join(*loc, *name->GetLocation());
+        return new NewExpr(*loc, new NamedType(name));
+    }
+    Expect('(');
+    if (code == T_NewArray) {
+        yyltype end;
+        Expr *size = ParseExpr(&end);
+        Expect(',');
+        Type *type = ParseType(&end);
+        *loc = Join(*loc, Expect(')'));
+        return new NewArrayExpr(*loc, size, type);
+    }
+    *loc = Join(*loc, Expect(')'));
+    if (code == T_ReadInteger)
+        return new ReadIntegerExpr(*loc);
+    return new ReadLineExpr(*loc);
+}
+
+/* Function: ParsePrimary
+ * ----------------------
+ * Parses an Expr that does not start with another one: an LValue or
+ * Call that starts with an identifier, a Constant, a parenthesized or
+ * unary expression, or one of the keyword expressions. Sets *lvalue if
+ * it is an LValue, which may be assigned to.
+ */
+static Expr *ParsePrimary(yyltype *loc, bool *lvalue) {
+    yyltype end;
+    Expr *expr;
+    *lvalue = false;
+    switch (Peek()) {
+      case T_Identifier: {
+        Identifier *name = ExpectIdentifier();
+        *loc = *name->GetLocation();
+        if (Peek() != '(') {
+            *lvalue = true;
+            return new FieldAccess(NULL, name);
+        }
+        Shift();
+        List<Expr*> *actuals = ParseActuals(&end);
+        *loc = Join(*loc, end);
+        return new Call(*loc, NULL, name, actuals);
+      }
+      case T_IntConstant: case T_BoolConstant: case T_DoubleConstant:
+      case T_StringConstant: case T_Null:
+        return ParseConstant(loc);
+      case T_ReadInteger: case T_ReadLine: case T_New: case T_NewArray:
+      case T_This:
+        return ParseKeywordExpr(loc);
+      case '(':
+        *loc = Shift();
+        expr = ParseExpr(&end);
+        *loc = Join(*loc, Expect(')'));
+        return expr;
+      case '-':
+        *loc = Shift();
+        expr = ParseSubexpr(UnaryPrec, &end);
+        expr = new ArithmeticExpr(new Operator(*loc, "-"), expr);
+        *loc = Join(*loc, end);
+        return expr;
+      case '!':
+        *loc = Shift();
+        expr = ParseSubexpr(UnaryPrec, &end);
+        expr = new LogicalExpr(new Operator(*loc, "!"), expr);
+        *loc = Join(*loc, end);
+        return expr;
+      default:
+        Fail("syntax error");
+        return NULL;
+    }
+}
+
+/* Function: ParsePostfix
+ * ----------------------
+ * Parses a field access, method call or array access on expr, which
+ * spans *loc, having peeked at its '.' or '['.
+ */
+static Expr *ParsePostfix(Expr *expr, yyltype *loc, bool *lvalue) {
+    yyltype end;
+    *lvalue = true;
+    if (Peek() == '[') {
+        Shift();
+        Expr *index = ParseExpr(&end);
+        *loc = Join(*loc, Expect(']'));
+        return new ArrayAccess(*loc, expr, index);
+    }
+    Shift();
+    Identifier *name = ExpectIdentifier();
+    if (Peek() != '(') {
+        *loc = Join(*loc, *name->GetLocation());
+        return new FieldAccess(expr, name);
+    }
+    Shift();
+    List<Expr*> *actuals = ParseActuals(&end);
+    *loc = Join(*loc, end);
+    *lvalue = false;
+    return new Call(*loc, expr, name, actuals);
+}
+
+static int BinaryPrec(int code) {
+    switch (code) {
+      case T_Or:
+        return OrPrec;
+      case T_And:
+        return AndPrec;
+      case T_Equal: case T_NotEqual:
+        return EqualityPrec;
+      case '<': case '>': case T_LessEqual: case T_GreaterEqual:
+        return RelationalPrec;
+      case '+': case '-':
+        return AdditivePrec;
+      case '*': case '/': case '%':
+        return MultiplicativePrec;
+      default:
+        return 0;
+    }
+}
+
+static Operator *MakeOperator(int code, yyltype loc) {
+    switch (code) {
+      case T_Equal:        return new Operator(loc, "==");
+      case T_NotEqual:     return new Operator(loc, "!=");
+      case T_LessEqual:    return new Operator(loc, "<=");
+      case T_GreaterEqual: return new Operator(loc, ">=");
+      case T_And:          return new Operator(loc, "&&");
+      case T_Or:           return new Operator(loc, "||");
+      case '+':            return new Operator(loc, "+");
+      case '-':            return new Operator(loc, "-");
+      case '*':            return new Operator(loc, "*");
+      case '/':            return new Operator(loc, "/");
+      case '%':            return new Operator(loc, "%");
+      case '<':            return new Operator(loc, "<");
+      default:             return new Operator(loc, ">");
+    }
+}
+
+static Expr *MakeBinary(Expr *left, Operator *op, int prec, Expr *right) {
+    switch (prec) {
+      case OrPrec: case AndPrec:
+        return new LogicalExpr(left, op, right);
+      case EqualityPrec:
+        return new EqualityExpr(left, op, right);
+      case RelationalPrec:
+        return new RelationalExpr(left, op, right);
+      default:
+        return new ArithmeticExpr(left, op, right);
+    }
+}
+
+/* Function: ParseSubexpr
+ * ----------------------
+ * Parses an Expr whose binary operators all bind at least as tightly as
+ * minPrec, setting *loc to its span. Postfix '.' and '[' bind tightest
+ * and always apply. An '=' applies whenever what precedes it is an
+ * LValue, whatever minPrec, since bison can only shift it there, and
+ * takes everything to its right. Two nonassociative operators of the
+ * same precedence in a row are a syntax error at the second.
+ */
+static Expr *ParseSubexpr(int minPrec, yyltype *loc) {
+    Enter();
+    bool lvalue;
+    Expr *expr = ParsePrimary(loc, &lvalue);
+    int nonassoc = 0;
+    for (;;) {
+        int code = Peek(), prec = BinaryPrec(code);
+        yyltype end;
+        if (code == '.' || code == '[')
+            expr = ParsePostfix(expr, loc, &lvalue);
+        else if (code == '=' && lvalue) {
+            Operator *op = new Operator(Shift(), "=");
+            Expr *value = ParseExpr(&end);
+            expr = new AssignExpr(expr, op, value);
+            *loc = Join(*loc, end);
+            lvalue = false;
+        } else if (prec != 0 && prec >= minPrec) {
+            if (prec == nonassoc)
+                Fail("syntax error");
+            Operator *op = MakeOperator(code, Shift());
+            Expr *right = ParseSubexpr(prec + 1, &end);
+            expr = MakeBinary(expr, op, prec, right);
+            *loc = Join(*loc, end);
+            lvalue = false;
+            if (prec == EqualityPrec || prec == RelationalPrec)
+                nonassoc = prec;
+            else
+                nonassoc = 0;
+        } else
+            break;
+    }
+    Leave();
+    return expr;
+}
+
+static Expr *ParseExpr(yyltype *loc) {
+    return ParseSubexpr(OrPrec, loc);
+}
+
+
+int ParseRecursiveDescent() {
+    char base;
+    struct rlimit limit;
+
+    numLookahead = 0;
+    depth = 0;
+    maxDepth = MaxParseDepth();
+    stackBase = &base;
+    stackBudget = (size_t)-1;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 &&
+        limit.rlim_cur != RLIM_INFINITY)
+        stackBudget = limit.rlim_cur / 2;
+    if (setjmp(abortParse) != 0)
+        return 1;
+
+    // Imports : Imports Import | /* empty */
+    // Import  : T_Identifier T_StringConstant ';', the identifier import
+    while (Peek() == T_Identifier && PeekSecond() == T_StringConstant) {
+        if (strcmp(lookahead[0].value.identifier, "import") != 0) {
+            Shift();
+            Fail("syntax error");
+        }
+        Shift();
+        char *path = lookahead[0].value.stringConstant;
+        yyltype loc = Shift();
+        Expect(';');
+        NoteImport(path, &loc);
+    }
+
+    List<Decl*> *decls = new List<Decl*>;
+    do {
+        Decl *decl = ParseDecl();
+        decls->Append(decl);
+        Program::Declare(decl);
+    } while (IsDeclStart(Peek()));
+
+    // Bison reduces the Program, and so checks it, on any token that
+    // cannot start another Decl, and only then finds it is not the end
+    Program *program = new Program(decls);
+    if (Program::NumParseErrors() == 0)
+        program->Check();
+    Expect(0);
+    return 0;
+}
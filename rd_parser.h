@@ -0,0 +1,25 @@
+/* File: rd_parser.h
+ * -----------------
+ * A hand-written parser that can stand in for the bison one (--rd-parse):
+ * recursive descent for declarations and statements, and precedence
+ * climbing (Pratt parsing) for expressions.
+ *
+ * It accepts exactly the language of parser.y and builds the same tree,
+ * with the same locations, by the same rules. It reads tokens through
+ * yylex() no further ahead than the bison parser does, and stops at the
+ * same token with the same "syntax error", so that the scanner reports
+ * the same errors too and the token stream modes work unchanged. The
+ * only difference is in how deep a program may nest before the parse
+ * fails with "memory exhausted": --max-parse-depth counts levels of
+ * nesting here rather than entries on bison's stacks, and the parse
+ * also fails that way before it could run out of stack.
+ */
+
+#ifndef _H_rd_parser
+#define _H_rd_parser
+
+// Parses a complete program, returning 0 on success and 1 on a syntax
+// error, like yyparse()
+int ParseRecursiveDescent();
+
+#endif
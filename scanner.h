@@ -12,12 +12,9 @@
 
 #define MaxIdentLen 31    // Maximum length for identifiers
 
-extern char *yytext;      // Text of lexeme just scanned
-
-
-int yylex();              // Defined in the generated lex.yy.c file
+int yylex();              // Defined in token_stream.cc
 
 void InitScanner();                 // Defined in scanner.l user subroutines
-const char *GetLineNumbered(int n); // ditto
+const char *GetLineNumbered(int n, size_t *length); // ditto
  
 #endif
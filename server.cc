@@ -0,0 +1,505 @@
+/* File: server.cc
+ * ---------------
+ * Implementation of the compile server and its client. The compiler
+ * keeps its state in globals, so the unit of isolation is the worker
+ * process: requests are compiled one at a time in each worker, which
+ * resets that state before each one. With --zygote, the worker is a
+ * child forked for the one request, and nothing is left to reset but
+ * the options.
+ */
+
+#include "server.h"
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ast_stmt.h"           // for Program::Reset
+#include "diagnostics.h"
+#include "source.h"
+#include "utility.h"
+using namespace std;
+
+int Compile();                  // Defined in main.cc
+
+static const int DefaultTimeout = 30;       // seconds per request
+static const int MaxRequests = 1000;        // per worker, see server.h
+static const uint32_t MaxFrame = 1 << 30;
+
+static volatile sig_atomic_t stopping = 0;
+static int connection = -1;     // the worker's current client
+static string timeoutResponse;
+static string serverModule;     // preloaded for every request, see Serve
+static bool failedRequest = false;
+
+// What ends a request that fails, thrown by OnFailure and caught by
+// HandleRequest, with what a direct run would have ended with
+struct RequestFailed
+{
+    string message;
+    int status;
+};
+
+
+static bool ReadFully(int fd, void *buf, size_t n) {
+    char *p = (char *)buf;
+    while (n > 0) {
+        ssize_t got = read(fd, p, n);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        p += got;
+        n -= got;
+    }
+    return true;
+}
+
+static bool WriteFully(int fd, const void *buf, size_t n) {
+    const char *p = (const char *)buf;
+    while (n > 0) {
+        ssize_t put = write(fd, p, n);
+        if (put < 0 && errno == EINTR)
+            continue;
+        if (put < 0)
+            return false;
+        p += put;
+        n -= put;
+    }
+    return true;
+}
+
+static bool ReadFrame(int fd, string &frame) {
+    uint32_t length;
+    if (!ReadFully(fd, &length, sizeof(length)) || length > MaxFrame)
+        return false;
+    frame.resize(length);
+    return length == 0 || ReadFully(fd, &frame[0], length);
+}
+
+static void AppendFrame(string &message, const void *data, uint32_t length) {
+    message.append((const char *)&length, sizeof(length));
+    message.append((const char *)data, length);
+}
+
+static string Response(const string &errors, int32_t status,
+                       const string &output = "") {
+    string message;
+    AppendFrame(message, errors.data(), errors.size());
+    AppendFrame(message, &status, sizeof(status));
+    AppendFrame(message, output.data(), output.size());
+    return message;
+}
+
+// Returns a socket connected to the one at path, or -1
+static int Connect(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        Failure("Socket path too long: %s", path);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        Failure("Cannot create socket");
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Function: Listen
+ * ----------------
+ * Binds a socket at path and listens on it, replacing a socket left
+ * behind by a server that is gone but not one that is still there.
+ */
+static int Listen(const char *path) {
+    int fd = Connect(path);
+    if (fd >= 0)
+        Failure("A server is already listening on %s", path);
+    unlink(path);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(fd, SOMAXCONN) != 0)
+        Failure("Cannot listen on %s", path);
+    return fd;
+}
+
+
+// Sends standard output to a temporary file until ReleaseOutput(), and
+// returns the file, or NULL if there is none to be had
+static FILE *CaptureOutput(int &saved) {
+    fflush(stdout);
+    FILE *file = tmpfile();
+    if (file == NULL)
+        return NULL;
+    saved = dup(STDOUT_FILENO);
+    dup2(fileno(file), STDOUT_FILENO);
+    return file;
+}
+
+// Restores standard output and returns what was written to it
+static string ReleaseOutput(FILE *file, int saved) {
+    string output;
+    if (file == NULL)
+        return output;
+    fflush(stdout);
+    cout.flush();
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    char buf[1 << 16];
+    rewind(file);
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), file)) > 0; )
+        output.append(buf, n);
+    fclose(file);
+    return output;
+}
+
+// The exit handler while a request is handled, so that a Failure() or
+// a bad command line ends the request rather than the worker
+static void OnFailure(const char *message, int status) {
+    RequestFailed failed = { message, status };
+    throw failed;
+}
+
+// Takes the command line of a request, opens its source and compiles
+// it, and returns the exit status
+static int CompileRequest(vector<char*> &argv, const string &source) {
+    ClearCommandLine();
+    ParseCommandLine(argv.size(), &argv[0]);
+    SetOption("serve", NULL);
+    SetOption("client", NULL);
+    SetOption("stream", NULL);
+    SetOption("emit-module", NULL);
+    if (!GetOption("module") && !serverModule.empty())
+        SetOption("module", serverModule.c_str());
+    Diagnostics::Clear();
+    Diagnostics::SetOrderKey(0);
+    Program::Reset();
+    CloseSource();
+
+    const char *path = GetInputFile();
+    if (source.empty() && path != NULL)
+        OpenSource(path);
+    else
+        OpenSourceText(source.data(), source.size());
+    return Compile();
+}
+
+/* Function: HandleRequest
+ * -----------------------
+ * Compiles the source of a request with its command line, from the
+ * state a fresh process would start in, and returns the response,
+ * with what the compile wrote to standard output, like the answers to
+ * --at. Options that only make sense for a process of its own are
+ * dropped. If the compile fails, or the command line is bad, the
+ * response has the message and exit status a direct run would have
+ * given; the compile is left halfway, so the worker exits after that.
+ */
+static string HandleRequest(string &args, const string &source) {
+    if (args.empty() || args[args.size() - 1] != '\0')
+        args += '\0';
+    vector<char*> argv(1, (char *)"dcc");
+    for (size_t i = 0; i < args.size(); i += strlen(&args[i]) + 1)
+        argv.push_back(&args[i]);
+    if (args.size() == 1)
+        argv.pop_back();
+
+    int saved, status;
+    FILE *file = CaptureOutput(saved);
+    SetExitHandler(OnFailure);
+    try {
+        status = CompileRequest(argv, source);
+    } catch (const RequestFailed &failed) {
+        SetExitHandler(NULL);
+        failedRequest = true;
+        string output = ReleaseOutput(file, saved);
+        return Response(failed.message, failed.status, output);
+    }
+    SetExitHandler(NULL);
+    string output = ReleaseOutput(file, saved);
+    string errors;
+    Diagnostics::Render(errors);
+    return Response(errors, status, output);
+}
+
+// The SIGALRM handler: a compile cannot be stopped halfway and resumed,
+// so the worker answers for it and exits
+static void OnTimeout(int sig) {
+    write(connection, timeoutResponse.data(), timeoutResponse.size());
+    _exit(1);
+}
+
+// Sets up a process to answer requests, each within timeout seconds
+static void SetUpWorker(int timeout) {
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGALRM, OnTimeout);
+    char failure[96];
+    snprintf(failure, sizeof(failure),
+             "\n*** Failure: Compile took over %d seconds\n\n", timeout);
+    timeoutResponse = Response(failure, 1);
+}
+
+// Answers the request on the connection fd, closes it and returns
+// whether there was a whole request to answer
+static bool Answer(int fd, int timeout) {
+    string args, source;
+    bool answered = (ReadFrame(fd, args) && ReadFrame(fd, source));
+    if (answered) {
+        connection = fd;
+        alarm(timeout);
+        string response = HandleRequest(args, source);
+        alarm(0);
+        WriteFully(fd, response.data(), response.size());
+    }
+    close(fd);
+    return answered;
+}
+
+static void RunWorker(int listener, int timeout) {
+    SetUpWorker(timeout);
+    for (int served = 0; served < MaxRequests; ) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            Failure("Cannot accept connections");
+        }
+        if (Answer(fd, timeout))
+            served++;
+        if (failedRequest)
+            break;
+    }
+    _exit(0);
+}
+
+static pid_t StartWorker(int listener, int timeout) {
+    pid_t pid = fork();
+    if (pid < 0)
+        Failure("Cannot start worker");
+    if (pid == 0)
+        RunWorker(listener, timeout);
+    return pid;
+}
+
+static void OnStop(int sig) {
+    stopping = 1;
+}
+
+/* Function: WarmUp
+ * ----------------
+ * Compiles a small program, with the module of the server if there is
+ * one, so that what the first compile of a process sets up is set up in
+ * the server already, to be shared with the processes forked from it.
+ * Of the server's own options only --signatures-only is kept for it, as
+ * the rest would have it write out or report on the program.
+ */
+static void WarmUp() {
+    static const char program[] = "void main() { Print(1); }\n";
+    const char *signaturesOnly = GetOption("signatures-only");
+    SaveCommandLine();              // which keeps signaturesOnly alive
+    if (!serverModule.empty())
+        SetOption("module", serverModule.c_str());
+    SetOption("signatures-only", signaturesOnly);
+    OpenSourceText(program, sizeof(program) - 1);
+    Compile();
+    CloseSource();
+    RestoreCommandLine();
+    Diagnostics::Clear();
+    Diagnostics::SetOrderKey(0);
+    Program::Reset();
+}
+
+/* Function: RunZygote
+ * -------------------
+ * Takes the connections off the socket itself and forks a child to
+ * answer each, which exits when it has; at most maxChildren at a time.
+ * Returns when told to stop, once its children are done.
+ */
+static void RunZygote(int listener, int maxChildren, int timeout) {
+    int numChildren = 0;
+    while (!stopping) {
+        while (numChildren > 0 && waitpid(-1, NULL, WNOHANG) > 0)
+            numChildren--;
+        if (numChildren >= maxChildren) {
+            if (waitpid(-1, NULL, 0) > 0)
+                numChildren--;
+            continue;
+        }
+
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            Failure("Cannot accept connections");
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listener);
+            SetUpWorker(timeout);
+            Answer(fd, timeout);
+            _exit(0);
+        }
+        close(fd);
+        if (pid < 0)
+            PrintDebug("serve", "Cannot fork for a request");
+        else
+            numChildren++;
+    }
+    while (wait(NULL) > 0)
+        ;
+}
+
+int Serve(const char *socketPath) {
+    const char *workers = GetOption("workers");
+    const char *timeout = GetOption("request-timeout");
+    int numWorkers = (workers ? atoi(workers) :
+                      sysconf(_SC_NPROCESSORS_ONLN));
+    int seconds = (timeout ? atoi(timeout) : DefaultTimeout);
+    if (numWorkers < 1)
+        numWorkers = 1;
+
+    int listener = Listen(socketPath);
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = OnStop;     // without SA_RESTART, to end waitpid
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    if (GetOption("module"))
+        serverModule = GetOption("module");
+    SetOption("emit-module", NULL);
+    WarmUp();
+    if (GetOption("zygote")) {
+        PrintDebug("serve", "Serving on %s, forking for each request",
+                   socketPath);
+        RunZygote(listener, numWorkers, seconds);
+        close(listener);
+        unlink(socketPath);
+        return 0;
+    }
+
+    vector<pid_t> pool;
+    for (int i = 0; i < numWorkers; i++)
+        pool.push_back(StartWorker(listener, seconds));
+    PrintDebug("serve", "Serving on %s with %d workers", socketPath,
+               numWorkers);
+
+    while (!stopping) {
+        pid_t pid = waitpid(-1, NULL, 0);
+        for (size_t i = 0; i < pool.size() && !stopping; i++)
+            if (pool[i] == pid) {
+                PrintDebug("serve", "Replacing worker %d", (int)pid);
+                pool[i] = StartWorker(listener, seconds);
+            }
+    }
+
+    for (size_t i = 0; i < pool.size(); i++)
+        kill(pool[i], SIGTERM);
+    while (wait(NULL) > 0)
+        ;
+    close(listener);
+    unlink(socketPath);
+    return 0;
+}
+
+// The options whose values are paths, which the client makes absolute
+// for the server, whose working directory is its own
+static const char *PathOptions[] = { "module", "ast-cache", "xref", NULL };
+
+// Returns path made absolute, whether or not there is anything there yet
+static string AbsolutePath(const char *path) {
+    char buf[PATH_MAX];
+    if (realpath(path, buf) != NULL)
+        return buf;
+    if (path[0] == '/')
+        return path;
+    if (getcwd(buf, sizeof(buf)) == NULL)
+        Failure("Cannot get the working directory");
+    return string(buf) + "/" + path;
+}
+
+// Returns the option as the server is to get it: one whose value is a
+// path, as --name=path with the path made absolute, unless it is "-",
+// for the standard output, which comes back in the response
+static string ServerArgument(const char *arg) {
+    for (int i = 0; PathOptions[i] != NULL; i++) {
+        size_t n = strlen(PathOptions[i]);
+        if (strncmp(arg + 2, PathOptions[i], n) == 0 &&
+            arg[2 + n] == '=' && arg[3 + n] != '\0' &&
+            strcmp(arg + 3 + n, "-") != 0)
+            return string(arg, 3 + n) + AbsolutePath(arg + 3 + n);
+    }
+    return arg;
+}
+
+int RunClient(const char *socketPath, int argc, char *argv[]) {
+    string args, source;
+    bool pastOptions = false;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--client", 8) == 0 &&
+            (argv[i][8] == '\0' || argv[i][8] == '='))
+            continue;
+        if (argv[i] == GetInputFile()) {
+            char path[PATH_MAX];
+            if (realpath(argv[i], path) == NULL)
+                Failure("Cannot open %s", argv[i]);
+            args += path;
+            pastOptions = true;
+        } else if (strncmp(argv[i], "--", 2) == 0 && !pastOptions)
+            args += ServerArgument(argv[i]);
+        else {
+            args += argv[i];
+            pastOptions = true;         // as ParseCommandLine() takes them
+        }
+        args += '\0';
+    }
+    if (GetInputFile() == NULL) {
+        char buf[1 << 16];
+        ssize_t n;
+        while ((n = read(STDIN_FILENO, buf, sizeof(buf))) != 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                Failure("Cannot read input");
+            source.append(buf, n);
+        }
+    }
+
+    int fd = Connect(socketPath);
+    if (fd < 0)
+        Failure("Cannot connect to %s", socketPath);
+    string request, errors, status, output;
+    AppendFrame(request, args.data(), args.size());
+    AppendFrame(request, source.data(), source.size());
+    if (!WriteFully(fd, request.data(), request.size()) ||
+        !ReadFrame(fd, errors) || !ReadFrame(fd, status) ||
+        status.size() != sizeof(int32_t) || !ReadFrame(fd, output))
+        Failure("Lost the connection to %s", socketPath);
+    close(fd);
+
+    WriteFully(STDOUT_FILENO, output.data(), output.size());
+    WriteFully(STDERR_FILENO, errors.data(), errors.size());
+    int32_t code;
+    memcpy(&code, status.data(), sizeof(code));
+    return code;
+}
@@ -0,0 +1,54 @@
+/* File: server.h
+ * --------------
+ * Compile server mode, for callers that run dcc over and over. With
+ * --serve=path, dcc binds a Unix domain socket at path and stays
+ * resident, so that startup and the setup of the built-in types are paid
+ * once rather than on every compile. It keeps a pool of worker processes
+ * (--workers=N, by default one per processor) which take connections
+ * off the socket and compile one request after another, each with its
+ * own options and from a fresh state. A worker that runs over the time
+ * budget for a request (--request-timeout=S seconds, default 30)
+ * answers with a failure and exits, as does one whose compile fails or
+ * whose command line is bad, once it has answered with the message and
+ * exit status a direct run would have given, and one that has served
+ * enough requests, since the trees the compiler builds are never freed;
+ * the server starts another in its place. Only a failure on the thread
+ * that handles the request is answered: one on a helper thread that
+ * --check-threads starts still ends the worker without an answer, and
+ * the client then fails with "Lost the connection".
+ *
+ * With --zygote as well, requests are isolated from each other: the
+ * server forks a child for each one, at most --workers at a time, which
+ * answers it and exits. The server warms itself up before taking any,
+ * by compiling a small program, so each child starts from a copy of a
+ * process that has set up everything a compile needs. Given --module,
+ * the server loads that module first (see module.h) and preloads it for
+ * every request that does not name one of its own, in either mode.
+ *
+ * With --client=path, dcc takes its usual arguments but has the server
+ * at path do the compile, and writes out the same output and errors and
+ * exits with the same status as it would have itself.
+ *
+ * Protocol: a message is a sequence of frames, each a 32-bit length in
+ * host byte order followed by that many bytes. A request is two frames:
+ * the command line, minus the program name and --client, with each
+ * argument NUL-terminated; and the source text. If the source frame is
+ * empty and the command line names a file, the server reads the file,
+ * so the path had better be absolute; the client makes it absolute, as
+ * it does the paths given to --module, --ast-cache and --xref. The
+ * response is three frames: the error output, the exit status as a
+ * 32-bit integer, and the standard output.
+ */
+
+#ifndef _H_server
+#define _H_server
+
+// Serves compile requests on the socket at socketPath until terminated
+// by SIGTERM or SIGINT, then returns the exit status
+int Serve(const char *socketPath);
+
+// Sends the compile asked for by the command line to the server at
+// socketPath, writes out its errors and returns its exit status
+int RunClient(const char *socketPath, int argc, char *argv[]);
+
+#endif
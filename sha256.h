@@ -0,0 +1,36 @@
+/* File: sha256.h
+ * --------------
+ * SHA-256 (FIPS 180-4), for keys that must not collide even when an
+ * adversary picks the inputs, like those of the result cache (see
+ * cache.h). The hash tables of the compiler itself do with FNV-1a.
+ */
+
+#ifndef _H_sha256
+#define _H_sha256
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+class Sha256
+{
+  public:
+    Sha256();
+
+    // Adds length bytes of data to the text being hashed
+    void Update(const void *data, size_t length);
+
+    // Returns the digest of the text as 64 lowercase hex digits. The
+    // object cannot be updated afterwards.
+    std::string HexDigest();
+
+  private:
+    uint32_t state[8];
+    uint64_t length;            // bytes hashed so far
+    unsigned char block[64];
+    size_t used;                // bytes of block filled
+
+    void Compress(const unsigned char *block);
+};
+
+#endif
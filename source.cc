@@ -0,0 +1,96 @@
+/* File: source.cc
+ * ---------------
+ * Implementation of access to the program source.
+ */
+
+#include "source.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "utility.h"
+
+static const char *text = NULL;
+static size_t length = 0;
+static int fd = 0;
+static char *buffer = NULL;     // holds the text unless it is mapped
+static size_t capacity = 0;
+static bool mapped = false;
+
+
+/* Function: MapSource
+ * -------------------
+ * Maps the open file fd into memory if it is a regular file read from
+ * its beginning. Returns false if the file has to be read instead.
+ */
+static bool MapSource() {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) ||
+        lseek(fd, 0, SEEK_CUR) != 0)
+        return false;
+
+    length = info.st_size;
+    if (length == 0) {
+        text = "";
+        return true;
+    }
+    void *mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+        return false;
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    text = (const char *)mapping;
+    mapped = true;
+    return true;
+}
+
+bool ReadMoreSource() {
+    if (length == capacity) {
+        capacity = (capacity == 0 ? 1 << 20 : 2 * capacity);
+        if ((buffer = (char *)realloc(buffer, capacity)) == NULL)
+            Failure("Out of memory reading input");
+        text = buffer;
+    }
+    ssize_t n = read(fd, buffer + length, capacity - length);
+    if (n < 0)
+        Failure("Cannot read input");
+    length += n;
+    return n > 0;
+}
+
+void OpenSource(const char *path) {
+    if (path != NULL && (fd = open(path, O_RDONLY)) < 0)
+        Failure("Cannot open %s", path);
+
+    if (GetOption("stream"))
+        text = "";
+    else if (MapSource())
+        PrintDebug("source", "Mapped %lu bytes", (unsigned long)length);
+    else
+        while (ReadMoreSource())
+            ;
+}
+
+void OpenSourceText(const char *t, size_t n) {
+    text = t;
+    length = n;
+}
+
+void CloseSource() {
+    if (mapped)
+        munmap((void *)text, length);
+    if (fd > 0)
+        close(fd);
+    text = NULL;
+    length = 0;
+    fd = 0;
+    mapped = false;
+}
+
+const char *GetSourceText() {
+    return text;
+}
+
+size_t GetSourceLength() {
+    return length;
+}
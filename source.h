@@ -0,0 +1,37 @@
+/* File: source.h
+ * --------------
+ * Access to the text of the program being compiled, which is always
+ * held in memory as a whole: the scanners read from it and the context
+ * shown with errors is sliced out of it. When the source is a regular
+ * file, whether named on the command line or redirected to standard
+ * input, it is mapped into memory read-only; input from a pipe or
+ * terminal is read in full.
+ *
+ * In streaming mode (--stream) OpenSource() reads nothing, and the text
+ * grows as the parser asks for more. It may move as it grows, so it
+ * should be looked up again after each ReadMoreSource().
+ */
+
+#ifndef _H_source
+#define _H_source
+
+#include <stddef.h>
+
+// Opens the source file at path, or standard input if path is NULL
+void OpenSource(const char *path);
+
+// Uses the given text as the source, without copying it
+void OpenSourceText(const char *text, size_t length);
+
+// Lets go of the source, e.g. before opening the next one
+void CloseSource();
+
+// Appends to the source text whatever input comes next, waiting for
+// some if need be. Returns false at end of input.
+bool ReadMoreSource();
+
+// Returns the source text, which is not NUL-terminated
+const char *GetSourceText();
+size_t GetSourceLength();
+
+#endif
@@ -0,0 +1,468 @@
+/* File: token_stream.cc
+ * ---------------------
+ * Implementation of the token stream feeding the parser.
+ *
+ * Ordering of errors in pipelined mode: the scanner thread stamps the
+ * errors it finds while scanning token j with order key 2j, and the
+ * parser stamps everything it reports after reading token j (syntax
+ * errors, and the semantic errors found once the last token is in) with
+ * 2j+1. Merging by key thus yields the interleaved order. If the parser
+ * stops early, the scanner may have run past the point where it would
+ * have stopped, and the errors it found there are dropped.
+ *
+ * Chunked mode uses the same keys, except that a region's scanner does
+ * not know how many tokens precede the region. It stamps token j with
+ * the provisional key base+2j, where base is far above any real key and
+ * different for each region; once the parser has been handed all the
+ * tokens before the region, the region's keys are shifted into place.
+ *
+ * Streaming mode runs on the main thread with the default key; see
+ * Program::Declare for the keys of the errors found along the way.
+ */
+
+#include "token_stream.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include "utility.h"
+#include "errors.h"
+#include "source.h"
+
+extern int yychar; // the token yypush_parse() takes, defined in y.tab.c
+
+static TokenRing *ring = NULL;
+static pthread_t scanThread;
+static volatile bool stopScanning = false;
+static unsigned int numConsumed = 0;
+
+static bool skipBodies = false;         // --signatures-only, see SkipBody
+static int bodyDepth = 0, lastCode = 0;
+static yyltype bodyStart;
+
+/* Struct: ScanRegion
+ * ------------------
+ * One region of the input in chunked mode, along with what the pre-pass
+ * and the region's scanning thread found out about it.
+ */
+struct ScanRegion
+{
+    const char *text;           // starts at the beginning of a line
+    size_t length;
+    int numLines;               // newlines in the region
+    bool endsInComment[2];      // indexed by whether it starts in one
+
+    int firstLine;
+    bool inComment;             // whether it starts inside a comment
+    orderKeyT keyBase;          // provisional key of its first token
+    pthread_t thread;
+
+    vector<Token> tokens;       // all its tokens, without the final 0
+    vector<size_t> lineStarts;  // offsets of the lines after its newlines
+    yyltype endLocation;        // location of its last lexeme
+    bool joined;
+    unsigned int firstToken;    // number of tokens before it, once joined
+};
+
+static const size_t MinRegionLength = 1 << 16;
+static const int RegionKeyShift = 40;
+
+static vector<ScanRegion*> regions;
+static size_t curRegion = 0, curToken = 0;
+static yyltype lastLocation;
+
+
+Token *TokenRing::WriteSlot() {
+    if (head - cachedTail == Capacity) {
+        cachedTail = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        if (head - cachedTail == Capacity)
+            return NULL;
+    }
+    return &slots[head & (Capacity - 1)];
+}
+
+void TokenRing::Publish() {
+    __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+}
+
+Token *TokenRing::ReadSlot() {
+    if (tail == cachedHead) {
+        cachedHead = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+        if (tail == cachedHead)
+            return NULL;
+    }
+    return &slots[tail & (Capacity - 1)];
+}
+
+void TokenRing::Release() {
+    __atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+
+/* Function: ScanAhead
+ * -------------------
+ * Body of the scanner thread in pipelined mode. The location is kept in
+ * a variable of its own that persists across tokens, just like yylloc
+ * does in interleaved mode, so that the end-of-input token carries the
+ * location of the last real token.
+ */
+static void *ScanAhead(void *unused) {
+    yyltype loc = yylloc;
+
+    for (unsigned int j = 0; ; j++) {
+        Token *t;
+        while ((t = ring->WriteSlot()) == NULL) {
+            if (stopScanning)
+                return NULL;
+            sched_yield();
+        }
+
+        Diagnostics::SetOrderKey(2 * (orderKeyT)j);
+        t->code = ScanToken(&t->value, &loc);
+        t->location = loc;
+        ring->Publish();
+
+        if (t->code == 0)
+            return NULL;
+    }
+}
+
+/* Function: SplitInput
+ * --------------------
+ * Cuts the input into about numRegions regions of similar length, each
+ * one ending just after a newline (the last one at the end of input).
+ */
+static void SplitInput(int numRegions) {
+    size_t length = GetSourceLength();
+    size_t target = max(length / numRegions, MinRegionLength);
+    const char *p = GetSourceText(), *end = p + length;
+
+    while (p < end) {
+        const char *stop = end;
+        if ((size_t)(end - p) > target) {
+            stop = (const char *)memchr(p + target, '\n', end - p - target);
+            stop = (stop == NULL ? end : stop + 1);
+        }
+        ScanRegion *r = new ScanRegion;
+        r->text = p;
+        r->length = stop - p;
+        r->joined = false;
+        regions.push_back(r);
+        p = stop;
+    }
+}
+
+typedef enum { InCode, InString, InLineComment, InBlockComment } skimStateT;
+
+/* Function: Skim
+ * --------------
+ * Follows just enough of Decaf's lexical structure through the text to
+ * tell where comments and strings start and end, and returns the state
+ * at the end. A string or // comment ends at the end of its line at the
+ * latest, which is what makes every newline in code a safe split point.
+ */
+static skimStateT Skim(const char *p, const char *end, skimStateT state) {
+    for (; p < end; p++) {
+        switch (state) {
+          case InCode:
+            if (*p == '"')
+                state = InString;
+            else if (*p == '/' && p + 1 < end && p[1] == '/')
+                state = InLineComment, p++;
+            else if (*p == '/' && p + 1 < end && p[1] == '*')
+                state = InBlockComment, p++;
+            break;
+          case InString:
+            if (*p == '"' || *p == '\n')
+                state = InCode;
+            break;
+          case InLineComment:
+            if (*p == '\n')
+                state = InCode;
+            break;
+          case InBlockComment:
+            if (*p == '*' && p + 1 < end && p[1] == '/')
+                state = InCode, p++;
+            break;
+        }
+    }
+    return state;
+}
+
+/* Function: SkimRegion
+ * --------------------
+ * Body of the pre-pass threads. Starting inside a comment, the region
+ * is in code again right after the first end of comment, so working out
+ * both ways it might start costs little more than one pass.
+ */
+static void *SkimRegion(void *arg) {
+    ScanRegion *r = (ScanRegion *)arg;
+    const char *end = r->text + r->length;
+
+    r->numLines = count(r->text, end, '\n');
+    r->endsInComment[false] = (Skim(r->text, end, InCode) == InBlockComment);
+    const char *close = (const char *)memmem(r->text, r->length, "*/", 2);
+    r->endsInComment[true] = (close == NULL ||
+                              Skim(close + 2, end, InCode) == InBlockComment);
+    return NULL;
+}
+
+/* Function: ScanRegionTokens
+ * --------------------------
+ * Body of the scanning threads in chunked mode.
+ */
+static void *ScanRegionTokens(void *arg) {
+    ScanRegion *r = (ScanRegion *)arg;
+    ScanState *scanner = NewScanner(r->text, r->length, r->firstLine,
+                                    r->inComment, r == regions.back(),
+                                    &r->lineStarts);
+    yyltype loc;
+    memset(&loc, 0, sizeof(loc));
+
+    for (unsigned int j = 0; !stopScanning; j++) {
+        Token t;
+        Diagnostics::SetOrderKey(r->keyBase + 2 * (orderKeyT)j);
+        if ((t.code = ScanToken(scanner, &t.value, &loc)) == 0)
+            break;
+        t.location = loc;
+        r->tokens.push_back(t);
+    }
+    r->endLocation = loc;
+    DeleteScanner(scanner);
+    return NULL;
+}
+
+static void StartChunkedScan() {
+    const char *threads = GetOption("scan-threads");
+    int numThreads = (threads ? atoi(threads) : sysconf(_SC_NPROCESSORS_ONLN));
+
+    SplitInput(max(numThreads, 1));
+    PrintDebug("tokens", "Scanning %d regions", (int)regions.size());
+
+    for (size_t k = 0; k < regions.size(); k++)
+        if (pthread_create(&regions[k]->thread, NULL, SkimRegion, regions[k]))
+            Failure("Cannot create scanner thread");
+    for (size_t k = 0; k < regions.size(); k++)
+        pthread_join(regions[k]->thread, NULL);
+
+    int line = 1;
+    bool inComment = false;
+    for (size_t k = 0; k < regions.size(); k++) {
+        ScanRegion *r = regions[k];
+        r->firstLine = line;
+        r->inComment = inComment;
+        r->keyBase = (orderKeyT)k << RegionKeyShift;
+        line += r->numLines;
+        inComment = r->endsInComment[inComment];
+    }
+
+    for (size_t k = 0; k < regions.size(); k++)
+        if (pthread_create(&regions[k]->thread, NULL, ScanRegionTokens,
+                           regions[k]))
+            Failure("Cannot create scanner thread");
+}
+
+/* Function: NextRegionToken
+ * -------------------------
+ * Hands out the next token in chunked mode, waiting for its region to be
+ * scanned if need be. At the end of input the location is that of the
+ * last lexeme, as it is when scanning sequentially.
+ */
+static int NextRegionToken() {
+    for (; curRegion < regions.size(); curRegion++, curToken = 0) {
+        ScanRegion *r = regions[curRegion];
+        if (!r->joined) {
+            pthread_join(r->thread, NULL);
+            r->joined = true;
+            r->firstToken = numConsumed;
+            lineStarts.insert(lineStarts.end(), r->lineStarts.begin(),
+                              r->lineStarts.end());
+            if (r->length > 0)
+                lastLocation = r->endLocation;
+        }
+        if (curToken < r->tokens.size()) {
+            Token &t = r->tokens[curToken++];
+            yylval = t.value;
+            yylloc = t.location;
+            return t.code;
+        }
+        vector<Token>().swap(r->tokens);
+    }
+    if (!regions.empty())
+        yylloc = lastLocation;
+    return 0;
+}
+
+/* Function: SkipBody
+ * ------------------
+ * With --signatures-only, folds each function body, from its '{' to the
+ * matching '}', into a single T_FnBody token, so that no statements are
+ * parsed, built or checked. Outside a body, a '{' right after a ')' can
+ * only start one. Takes the tokens in order and returns the code to pass
+ * on to the parser, or -1 for a token swallowed; *loc becomes the span
+ * of the whole body for T_FnBody.
+ */
+static int SkipBody(int code, yyltype *loc) {
+    if (bodyDepth == 0) {
+        if (code != '{' || lastCode != ')')
+            return (lastCode = code);
+        bodyStart = *loc;
+    } else if (code == 0) {
+        bodyDepth = 0;        // unterminated, for the parser to report
+        return 0;
+    }
+    if (code == '{')
+        bodyDepth++;
+    else if (code == '}' && --bodyDepth == 0) {
+        *loc = Join(bodyStart, *loc);
+        return (lastCode = T_FnBody);
+    }
+    return -1;
+}
+
+/* Function: ParseStream
+ * ---------------------
+ * The driver of streaming mode. Each time more input arrives, the lines
+ * completed by it are scanned, with a scanner of their own that starts
+ * where the previous one left off, and their tokens are pushed into the
+ * parser. As in ScanAhead, the location persists from one token to the
+ * next, and from one scanner to the next.
+ */
+void ParseStream() {
+    yypstate *parser = yypstate_new();
+    yyltype loc = yylloc;
+    size_t scanned = 0;
+    int line = 1;
+    bool inComment = false, more = true;
+    int status = YYPUSH_MORE;
+
+    while (status == YYPUSH_MORE) {
+        more = ReadMoreSource();
+        const char *text = GetSourceText() + scanned;
+        const char *end = GetSourceText() + GetSourceLength();
+        if (more) {
+            const char *last = (const char *)memrchr(text, '\n', end - text);
+            if (last == NULL)
+                continue;
+            end = last + 1;
+        }
+        PrintDebug("stream", "Scanning %lu bytes",
+                   (unsigned long)(end - text));
+
+        ScanState *scanner = NewScanner(text, end - text, line, inComment,
+                                        !more, &lineStarts);
+        for (;;) {
+            int code = ScanToken(scanner, &yylval, &loc);
+            if (code == 0 && more)
+                break;
+            yylloc = loc;
+            if (skipBodies && (code = SkipBody(code, &yylloc)) < 0)
+                continue;
+            yychar = code;
+            status = yypush_parse(parser);
+            if (code == 0 || status != YYPUSH_MORE)
+                break;
+        }
+        DeleteScanner(scanner);
+
+        scanned = end - GetSourceText();
+        line += count(text, end, '\n');
+        inComment = (Skim(text, end, inComment ? InBlockComment : InCode) ==
+                     InBlockComment);
+    }
+    yypstate_delete(parser);
+
+    if (Program::NumParseErrors() > 0)
+        Program::DiscardEarlyErrors();
+}
+
+void InitTokenStream() {
+    stopScanning = false;
+    numConsumed = 0;
+    curRegion = curToken = 0;
+    skipBodies = (GetOption("signatures-only") != NULL);
+    bodyDepth = lastCode = 0;
+    if (GetOption("stream"))
+        return;
+    if (GetOption("chunked")) {
+        StartChunkedScan();
+        return;
+    }
+    if (!GetOption("pipeline"))
+        return;
+
+    PrintDebug("tokens", "Starting scanner thread");
+    ring = new TokenRing;
+    if (pthread_create(&scanThread, NULL, ScanAhead, NULL) != 0)
+        Failure("Cannot create scanner thread");
+}
+
+/* Function: FinishTokenStream
+ * ---------------------------
+ * Stops the scanner threads. In chunked mode, this is also where the
+ * keys of the regions the parser got to are shifted into place, as no
+ * thread is recording diagnostics any more.
+ */
+void FinishTokenStream() {
+    if (ring == NULL && regions.empty())
+        return;
+
+    stopScanning = true;
+    if (ring != NULL) {
+        pthread_join(scanThread, NULL);
+        delete ring;
+        ring = NULL;
+    }
+    for (size_t k = 0; k < regions.size(); k++) {
+        ScanRegion *r = regions[k];
+        if (!r->joined)
+            pthread_join(r->thread, NULL);
+        else if (k > 0)
+            Diagnostics::ShiftKeys(r->keyBase, r->keyBase +
+                                   ((orderKeyT)1 << RegionKeyShift),
+                                   2 * (orderKeyT)r->firstToken);
+        delete r;
+    }
+    regions.clear();
+    Diagnostics::DiscardFrom(2 * (orderKeyT)numConsumed);
+}
+
+/* Function: NextToken
+ * -------------------
+ * Returns the next token from the scanner, whichever way it is run,
+ * setting yylval and yylloc.
+ */
+static int NextToken() {
+    if (!regions.empty()) {
+        Diagnostics::SetOrderKey(2 * (orderKeyT)numConsumed + 1);
+        int code = NextRegionToken();
+        numConsumed++;
+        return code;
+    }
+    if (ring == NULL)
+        return ScanToken(&yylval, &yylloc);
+
+    Token *t;
+    while ((t = ring->ReadSlot()) == NULL)
+        sched_yield();
+
+    Diagnostics::SetOrderKey(2 * (orderKeyT)numConsumed++ + 1);
+    int code = t->code;
+    yylval = t->value;
+    yylloc = t->location;
+    ring->Release();
+    return code;
+}
+
+/* Function: yylex
+ * ---------------
+ * Returns the next token for the parser, setting yylval and yylloc.
+ */
+int yylex() {
+    int code;
+    do
+        code = NextToken();
+    while (skipBodies && (code = SkipBody(code, &yylloc)) < 0);
+    return code;
+}
@@ -0,0 +1,118 @@
+/* File: token_stream.h
+ * --------------------
+ * The token stream sits between the scanner and the parser. yyparse()
+ * pulls each token through yylex(), which is defined here rather than
+ * by flex. In the default, interleaved mode yylex() just runs the
+ * scanner for one token. In pipelined mode (--pipeline) a scanner thread
+ * runs ahead of the parser, depositing tokens with their semantic values
+ * and locations in a single-producer/single-consumer ring buffer that
+ * yylex() drains.
+ *
+ * In chunked mode (--chunked) the input is split at line boundaries
+ * into regions, one per scanning thread (--scan-threads=N, by default
+ * one per processor). A quick pre-pass
+ * over each region works out whether it ends inside a comment for either
+ * way it might start; strings and // comments cannot span lines, so that
+ * is all it takes to give each region's scanner its correct starting
+ * state. The regions are then scanned concurrently and yylex() hands out
+ * their tokens in order, each region as soon as it is done.
+ *
+ * Streaming mode (--stream) is for input that arrives over time, e.g.
+ * from a program writing Decaf into a pipe. Instead of calling yyparse(),
+ * which pulls all its tokens through yylex(), ParseStream() reads the
+ * input as it comes and pushes the tokens of each complete line into
+ * bison's push parser right away; each top-level declaration goes on to
+ * the first steps of semantic analysis as soon as it is parsed.
+ *
+ * In any of these modes, --signatures-only has the token stream fold
+ * each function body into a single token, so that the parser and the
+ * semantic checks only ever see declarations.
+ */
+
+#ifndef _H_token_stream
+#define _H_token_stream
+
+#include "parser.h" // for YYSTYPE, yylval
+#include <vector>
+using namespace std;
+
+/* Struct: Token
+ * -------------
+ * A scanned token: its code as returned to the parser along with the
+ * semantic value and location that go with it.
+ */
+struct Token
+{
+    int code;
+    YYSTYPE value;
+    yyltype location;
+};
+
+/* Class: TokenRing
+ * ----------------
+ * Lock-free ring buffer handing tokens from exactly one producer thread
+ * to exactly one consumer thread. The producer fills the slot returned
+ * by WriteSlot() and then calls Publish(); the consumer reads the slot
+ * returned by ReadSlot() and then calls Release(). Both return NULL when
+ * the ring is full (empty, respectively).
+ */
+class TokenRing
+{
+  public:
+    static const unsigned int Capacity = 4096; // must be a power of 2
+
+    TokenRing() : head(0), cachedTail(0), tail(0), cachedHead(0) {}
+
+    Token *WriteSlot();
+    void Publish();
+    Token *ReadSlot();
+    void Release();
+
+  private:
+    Token slots[Capacity];
+
+    // head is only written by the producer, tail only by the consumer.
+    // Each side keeps a cached copy of the other's index and re-reads
+    // the shared one only when the cached copy says it has to wait.
+    unsigned int head __attribute__((aligned(64)));
+    unsigned int cachedTail;
+    unsigned int tail __attribute__((aligned(64)));
+    unsigned int cachedHead;
+};
+
+/* Struct: ScanState
+ * -----------------
+ * Everything a scanner instance keeps between calls. The default scanner
+ * reads the whole source; in chunked mode each region of it gets a
+ * scanner of its own. The flex scanner hangs this off its yyextra, the
+ * fast scanner (--fast-scan) needs nothing else.
+ */
+struct ScanState
+{
+    void *scanner;              // flex's yyscan_t, NULL for the fast one
+    int curLineNum, curColNum;
+    size_t offset;              // source offset of the next character
+    vector<size_t> *lineStarts; // where the offsets of new lines go
+    const char *next, *end;     // text yet to be read
+    bool inComment;             // fast scanner only: inside a /* comment
+    bool endsInput;             // whether end of text is end of input
+    YYSTYPE *tokenValue;        // where the current token's value and
+    yyltype *tokenLocation;     //   location go, set by ScanToken
+};
+
+// Scanner interface, defined in scanner.l. The first form of ScanToken
+// uses the default scanner over the whole source; the others deal with
+// scanners over a piece of it.
+int ScanToken(YYSTYPE *value, yyltype *loc);
+int ScanToken(ScanState *scanner, YYSTYPE *value, yyltype *loc);
+ScanState *NewScanner(const char *text, size_t length, int firstLine,
+                      bool inComment, bool endsInput,
+                      vector<size_t> *lineStarts);
+void DeleteScanner(ScanState *scanner);
+extern vector<size_t> lineStarts;
+
+void InitTokenStream();     // call after InitScanner(), before yyparse()
+void FinishTokenStream();   // call after yyparse() returns
+void ParseStream();         // call instead of yyparse() to stream
+
+#endif
@@ -5,13 +5,26 @@
  */
 
 #include "utility.h"
+#include <signal.h>
 #include <stdarg.h>
 #include <string.h>
 #include <vector>
 using std::vector;
+using std::pair;
+using std::make_pair;
 
 static vector<const char*> debugKeys;
+static vector<pair<const char*, const char*> > options;
+static const char *inputFile = NULL;
+static vector<const char*> savedDebugKeys;
+static vector<pair<const char*, const char*> > savedOptions;
+static const char *savedInputFile = NULL;
 static const int BufferSize = 2048;
+static __thread ExitHandler exitHandler = NULL;
+
+void SetExitHandler(ExitHandler handler) {
+  exitHandler = handler;
+}
 
 void Failure(const char *format, ...) {
   va_list args;
@@ -21,6 +34,11 @@ void Failure(const char *format, ...) {
   vsprintf(errbuf, format, args);
   va_end(args);
   fflush(stdout);
+  if (exitHandler) {
+    char message[BufferSize + 32];
+    snprintf(message, sizeof(message), "\n*** Failure: %s\n\n", errbuf);
+    exitHandler(message, 128 + SIGABRT);  // as the shell sees abort()
+  }
   fprintf(stderr,"\n*** Failure: %s\n\n", errbuf);
   abort();
 }
@@ -58,19 +76,95 @@ void PrintDebug(const char *key, const char *format, ...) {
   printf("+++ (%s): %s%s", key, buf, buf[strlen(buf)-1] != '\n'? "\n" : "");
 }
 
+static int OptionIndex(const char *name) {
+  for (unsigned int i = 0; i < options.size(); i++)
+    if (!strcmp(options[i].first, name))
+      return i;
+
+  return -1;
+}
+
+const char *GetOption(const char *name) {
+  int k = OptionIndex(name);
+  return (k == -1 ? NULL : options[k].second);
+}
+
+void SetOption(const char *name, const char *value) {
+  int k = OptionIndex(name);
+  if (k != -1)
+    options.erase(options.begin() + k);
+  if (value)
+    options.push_back(make_pair(strdup(name), strdup(value)));
+}
+
+const char *GetInputFile() {
+  return inputFile;
+}
+
+void SetInputFile(const char *path) {
+  inputFile = path;
+}
+
+static void Usage(int argc, char *argv[]) {
+  printf("Incorrect Use:   ");
+  for (int i = 1; i < argc; i++)   // less --client, as run directly
+    if (strncmp(argv[i], "--client", 8) != 0) printf("%s ", argv[i]);
+  printf("\n");
+  printf("Correct Usage:   [--option[=value] ...] [file] [-d <debug-key-1> <debug-key-2> ...]\n");
+  if (exitHandler) {
+    fflush(stdout);
+    exitHandler("", 2);
+  }
+  exit(2);
+}
+
+void ClearCommandLine() {
+  for (unsigned int i = 0; i < options.size(); i++) {
+    free((char *)options[i].first);
+    free((char *)options[i].second);
+  }
+  options.clear();
+  debugKeys.clear();
+  inputFile = NULL;
+}
+
+void SaveCommandLine() {
+  savedOptions.swap(options);
+  savedDebugKeys.swap(debugKeys);
+  savedInputFile = inputFile;
+  ClearCommandLine();
+}
+
+void RestoreCommandLine() {
+  ClearCommandLine();
+  options.swap(savedOptions);
+  debugKeys.swap(savedDebugKeys);
+  inputFile = savedInputFile;
+}
+
 void ParseCommandLine(int argc, char *argv[]) {
-  if (argc == 1)
-    return;
-  
-  if (strcmp(argv[1], "-d") != 0) { // first arg is not -d
-    printf("Incorrect Use:   ");
-    for (int i = 1; i < argc; i++) printf("%s ", argv[i]);
-    printf("\n");
-    printf("Correct Usage:   -d <debug-key-1> <debug-key-2> ... \n");
-    exit(2);
+  int i = 1;
+
+  for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+    char *name = strdup(argv[i] + 2);
+    char *value = strchr(name, '=');
+    if (value)
+      *value++ = '\0';
+    if (*name == '\0')
+      Usage(argc, argv);
+    SetOption(name, value ? value : "");
+    free(name);
   }
 
-  for (int i = 2; i < argc; i++)
+  if (i < argc && argv[i][0] != '-')
+    inputFile = argv[i++];
+
+  if (i == argc)
+    return;
+
+  if (strcmp(argv[i], "-d") != 0) // remaining args do not start with -d
+    Usage(argc, argv);
+
+  for (i++; i < argc; i++)
     SetDebugForKey(argv[i], true);
 }
-
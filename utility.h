@@ -23,6 +23,22 @@
 
 void Failure(const char *format, ...);
 
+/**
+ * Function: SetExitHandler()
+ * Usage: SetExitHandler(OnExit);
+ * ------------------------------
+ * Has Failure(), and ParseCommandLine() when it prints the correct usage,
+ * call the handler rather than exit, with the message Failure() would
+ * have printed to stderr (the usage goes to stdout as ever) and the exit
+ * status the shell would have seen. This is only for the thread that set
+ * it, and the handler must not return, e.g. it can throw; a compile
+ * server uses it to answer a request that fails (see server.h). NULL
+ * goes back to exiting.
+ */
+
+typedef void (*ExitHandler)(const char *message, int status);
+void SetExitHandler(ExitHandler handler);
+
 /**
  * Macro: Assert()
  * Usage: Assert(num > 0);
@@ -73,14 +89,80 @@ void SetDebugForKey(const char *key, bool val);
 
 bool IsDebugOn(const char *key);
 
+/**
+ * Function: GetOption()
+ * Usage: if (GetOption("pipeline")) ...
+ * -------------------------------------
+ * Returns the value given for the option --name on the command line,
+ * the empty string for an option given without a value, or NULL if the
+ * option was not given at all.
+ */
+
+const char *GetOption(const char *name);
+
+/**
+ * Function: SetOption()
+ * Usage: SetOption("pipeline", "");
+ * ---------------------------------
+ * Sets an option as though it had been given on the command line. A
+ * NULL value removes the option.
+ */
+
+void SetOption(const char *name, const char *value);
+
+/**
+ * Function: GetInputFile()
+ * Usage: const char *path = GetInputFile();
+ * -----------------------------------------
+ * Returns the source file named on the command line, or NULL if the
+ * source is to be read from standard input.
+ */
+
+const char *GetInputFile();
+
+/**
+ * Function: SetInputFile()
+ * Usage: SetInputFile(path);
+ * --------------------------
+ * Sets the source file as though it had been named on the command line,
+ * for a process that compiles one file after another (see watch.h). The
+ * path is not copied.
+ */
+
+void SetInputFile(const char *path);
+
 /**
  * Function: ParseCommandLine
  * --------------------------
- * Turn on the debugging flags from the command line.  Verifies that
- * first argument is -d, and then interpret all the arguments that follow
- * as being flags to turn on.
+ * Turn on the options and debugging flags from the command line. Options
+ * are of the form --name or --name=value and come first. They may be
+ * followed by the name of the source file and then by -d, in which case
+ * all the arguments that follow are interpreted as being debug flags to
+ * turn on.
  */
 
 void ParseCommandLine(int argc, char *argv[]);
+
+/**
+ * Function: ClearCommandLine
+ * --------------------------
+ * Forgets all options, debugging flags and the input file, so that a
+ * process compiling one program after another (see server.h) can take
+ * the command line of each in turn.
+ */
+
+void ClearCommandLine();
+
+/**
+ * Function: SaveCommandLine, RestoreCommandLine
+ * ---------------------------------------------
+ * SaveCommandLine sets aside all options, debugging flags and the input
+ * file, leaving none, and RestoreCommandLine puts them back, for a
+ * compile of the process's own that is not to see them (see server.h).
+ * Only one command line is set aside at a time.
+ */
+
+void SaveCommandLine();
+void RestoreCommandLine();
      
 #endif
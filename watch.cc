@@ -0,0 +1,231 @@
+/* File: watch.cc
+ * --------------
+ * Implementation of watch mode. Files are read into memory rather than
+ * mapped, since an editor may be rewriting one while it is compiled.
+ */
+
+#include "watch.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "ast_stmt.h"           // for Program::Reset
+#include "diagnostics.h"
+#include "errors.h"
+#include "imports.h"
+#include "source.h"
+#include "utility.h"
+using namespace std;
+
+int Compile();                  // Defined in main.cc
+
+static const int QuietPeriod = 25;          // milliseconds, ends a burst
+static const int MaxRechecks = 1000;        // before starting over
+static const uint32_t WatchedEvents = (IN_CLOSE_WRITE | IN_MOVED_TO |
+                                       IN_DELETE | IN_MOVED_FROM |
+                                       IN_DELETE_SELF | IN_MOVE_SELF);
+
+// What each watched file imported when it was last checked, directly or
+// not, by the name of the file and as GetImportedPaths() gives it
+static map<string, vector<string> > imported;
+
+static bool IsSource(const char *name) {
+    size_t n = strlen(name);
+    return name[0] != '.' && n > 6 && strcmp(name + n - 6, ".decaf") == 0;
+}
+
+static bool ReadFile(const char *path, string &text) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    text.clear();
+    char buf[1 << 16];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            break;
+        text.append(buf, n);
+    }
+    close(fd);
+    return n == 0;
+}
+
+static double Milliseconds(const struct timespec &start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec - start.tv_sec) * 1e3 +
+            (now.tv_nsec - start.tv_nsec) / 1e6);
+}
+
+/* Function: Check
+ * ---------------
+ * Compiles the file at path from a fresh state, as the server does a
+ * request, and writes out its errors under a line saying how it went.
+ * The checks of the file's last version are kept by --incremental.
+ * Notes what the file imports, for Importers.
+ */
+static void Check(const string &name, const string &path) {
+    static string text;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    imported.erase(name);
+    if (!ReadFile(path.c_str(), text)) {
+        printf("== %s: removed\n", path.c_str());
+        fflush(stdout);
+        return;
+    }
+
+    Diagnostics::Clear();
+    Diagnostics::SetOrderKey(0);
+    Program::Reset();
+    CloseSource();
+    SetInputFile(path.c_str());
+    OpenSourceText(text.data(), text.size());
+    Compile();
+    double elapsed = Milliseconds(start);
+    GetImportedPaths(imported[name]);
+
+    string errors;
+    Diagnostics::Render(errors);
+    int numErrors = ReportError::NumErrors();
+    printf("== %s: %d error%s, checked in %.2f ms\n", path.c_str(),
+           numErrors, numErrors == 1 ? "" : "s", elapsed);
+    fwrite(errors.data(), 1, errors.size(), stdout);
+    fflush(stdout);
+    SetInputFile(NULL);
+}
+
+/* Function: ReadEvents
+ * --------------------
+ * Waits up to timeout milliseconds (forever if negative) for events on
+ * the inotify descriptor fd, and adds to changed the names of the sources
+ * they are about. Returns false if there were none in time. Sets gone
+ * if the directory itself was removed or moved away.
+ */
+static bool ReadEvents(int fd, int timeout, set<string> &changed,
+                       bool &gone) {
+    struct pollfd p = { fd, POLLIN, 0 };
+    int ready = poll(&p, 1, timeout);
+    if (ready < 0 && errno == EINTR)
+        return true;
+    if (ready <= 0)
+        return false;
+
+    char buf[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR)
+        return true;
+    if (n <= 0)
+        Failure("Cannot read inotify events");
+    for (char *e = buf; e < buf + n; ) {
+        const struct inotify_event *event = (struct inotify_event *)e;
+        if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+            gone = true;
+        else if (event->len > 0 && IsSource(event->name)) {
+            PrintDebug("watch", "Event %#x on %s", event->mask, event->name);
+            changed.insert(event->name);
+        }
+        e += sizeof(struct inotify_event) + event->len;
+    }
+    return true;
+}
+
+/* Function: Importers
+ * -------------------
+ * Adds to changed the names of the files that import one of those in it,
+ * directly or not, as of their last check, so that they are checked
+ * again too. real is the real path of the directory, ending in '/'.
+ */
+static void Importers(const string &real, set<string> &changed) {
+    set<string> paths;
+    for (set<string>::iterator i = changed.begin(); i != changed.end(); ++i)
+        paths.insert(real + *i);
+    for (map<string, vector<string> >::iterator i = imported.begin();
+         i != imported.end(); ++i)
+        for (size_t j = 0; j < i->second.size(); j++)
+            if (paths.count(i->second[j]) > 0) {
+                PrintDebug("watch", "%s imports %s", i->first.c_str(),
+                           i->second[j].c_str());
+                changed.insert(i->first);
+                break;
+            }
+}
+
+int Watch(const char *dir, char *argv[]) {
+    SetOption("incremental", "");
+    SetOption("stream", NULL);
+
+    // The watch is set up first, so no change is missed while the
+    // directory is read
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0)
+        Failure("Cannot use inotify");
+    if (inotify_add_watch(fd, dir, WatchedEvents) < 0)
+        Failure("Cannot watch %s", dir);
+
+    string prefix = dir;
+    while (prefix.size() > 1 && prefix[prefix.size() - 1] == '/')
+        prefix.erase(prefix.size() - 1);
+    if (prefix[prefix.size() - 1] != '/')
+        prefix += '/';
+    char buf[PATH_MAX];
+    if (realpath(dir, buf) == NULL)
+        Failure("Cannot watch %s", dir);
+    string real = buf;
+    if (real[real.size() - 1] != '/')
+        real += '/';
+
+    set<string> names;
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        Failure("Cannot read %s", dir);
+    for (struct dirent *entry; (entry = readdir(d)) != NULL; )
+        if (IsSource(entry->d_name))
+            names.insert(entry->d_name);
+    closedir(d);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (set<string>::iterator i = names.begin(); i != names.end(); ++i)
+        Check(*i, prefix + *i);
+    printf("== Checked %d file%s in %.2f ms, watching %s\n",
+           (int)names.size(), names.size() == 1 ? "" : "s",
+           Milliseconds(start), dir);
+    fflush(stdout);
+
+    for (int rechecks = 0; rechecks < MaxRechecks; ) {
+        set<string> changed;
+        bool gone = false;
+        ReadEvents(fd, -1, changed, gone);
+        while (ReadEvents(fd, QuietPeriod, changed, gone))
+            ;
+        if (gone) {
+            printf("== %s is gone\n", dir);
+            return 1;
+        }
+        Importers(real, changed);
+        for (set<string>::iterator i = changed.begin(); i != changed.end();
+             ++i, ++rechecks)
+            Check(*i, prefix + *i);
+    }
+
+    PrintDebug("watch", "Starting over after %d re-checks", MaxRechecks);
+    fflush(stdout);
+    execv("/proc/self/exe", argv);
+    Failure("Cannot start over");
+    return 1;
+}
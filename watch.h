@@ -0,0 +1,31 @@
+/* File: watch.h
+ * -------------
+ * Watch mode, for running dcc on every save. With --watch dir (or
+ * --watch=dir), dcc checks each .decaf file in the directory, then
+ * stays resident and uses inotify to learn of files that are written,
+ * created, moved in or removed. Each file that changed is compiled
+ * again and its errors written out afresh, headed by a line giving the
+ * file, the number of errors and how long the re-check took. Editors
+ * often write a file in several steps, so changes are gathered until
+ * the directory has been quiet for a moment and then handled together,
+ * each file once. A file in the directory that imports one that changed,
+ * directly or not, or that names one missing which has now appeared, is
+ * checked again along with it (see imports.h); only the directory is
+ * watched, so changes to files outside it are not seen.
+ *
+ * Files are compiled with --incremental (see incremental.h), which keeps
+ * the checks of each file in memory, so a re-check only redoes those of
+ * the declarations that changed and of those depending on them. The
+ * trees the compiler builds are never freed, so after many re-checks
+ * dcc starts itself over with the same command line, checking every
+ * file in full once more.
+ */
+
+#ifndef _H_watch
+#define _H_watch
+
+// Checks the files in dir and then each one that changes, until killed.
+// argv is the command line, for starting over.
+int Watch(const char *dir, char *argv[]);
+
+#endif
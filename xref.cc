@@ -0,0 +1,96 @@
+/* File: xref.cc
+ * -------------
+ * Implementation of the cross-reference index. Each line is written with
+ * one call to fprintf, which stdio does under the stream's lock, so the
+ * lines of threads checking different files do not run into each other.
+ */
+
+#include "xref.h"
+#include <stdio.h>
+#include <string.h>
+#include "ast_decl.h"
+#include "ast_stmt.h"
+#include "ast_type.h"
+#include "diagnostics.h"
+#include "imports.h"
+#include "utility.h"
+
+bool writingXrefs = false;
+static FILE *out;
+static const int BufferSize = 1 << 20;
+
+
+void BeginXrefs() {
+    const char *path = GetOption("xref");
+    if (path == NULL)
+        return;
+    if (strcmp(path, "-") == 0)
+        out = stdout;
+    else if ((out = fopen(path, "w")) == NULL)
+        Failure("Cannot write cross-references to %s", path);
+    else
+        setvbuf(out, NULL, _IOFBF, BufferSize);
+    writingXrefs = true;
+}
+
+void EndXrefs() {
+    if (!writingXrefs)
+        return;
+    writingXrefs = false;
+    if (out == stdout ? fflush(out) != 0 : fclose(out) != 0)
+        Failure("Cannot write cross-references to %s", GetOption("xref"));
+    out = NULL;
+}
+
+// Returns the name of file number n of the program, as GetDeclFile()
+// numbers them
+static const char *FileName(int n) {
+    if (n < 0)
+        return (GetOption("module") != NULL ? GetOption("module") : "-");
+    const char *name = GetFileName(n);
+    if (name != NULL)
+        return name;
+    return (GetInputFile() != NULL ? GetInputFile() : "<stdin>");
+}
+
+static const char *Kind(Decl *decl) {
+    if (dynamic_cast<VarDecl*>(decl) != NULL)
+        return "var";
+    if (dynamic_cast<FnDecl*>(decl) != NULL)
+        return "fn";
+    if (dynamic_cast<ClassDecl*>(decl) != NULL)
+        return "class";
+    return "interface";
+}
+
+void NoteDeclaration(Decl *decl) {
+    yyltype *loc = decl->GetLocation();
+    fprintf(out, "D\t%s\t%d:%d\t%s\t%s\n", FileName(Diagnostics::GetFile()),
+            loc->first_line, loc->first_column, Kind(decl), decl->Name());
+}
+
+void NoteUse(Identifier *name, Decl *decl) {
+    yyltype *loc = name->GetLocation(), *declLoc = decl->GetLocation();
+    fprintf(out, "U\t%s\t%d:%d\t%s\t%d:%d\n",
+            FileName(Diagnostics::GetFile()), loc->first_line,
+            loc->first_column, FileName(GetDeclFile(decl)),
+            declLoc->first_line, declLoc->first_column);
+}
+
+void NoteTypeUse(Type *type, Scope *scope) {
+    for (ArrayType *a; (a = dynamic_cast<ArrayType*>(type)) != NULL; )
+        type = a->GetElemType();
+    NamedType *named = dynamic_cast<NamedType*>(type);
+    if (named == NULL)
+        return;
+
+    for (Scope *s = scope; s != NULL; s = s->GetParent()) {
+        Decl *d = s->Lookup(named->Name());
+        if (d == NULL)
+            continue;
+        if (dynamic_cast<ClassDecl*>(d) != NULL ||
+            dynamic_cast<InterfaceDecl*>(d) != NULL)
+            NoteUse(named->GetId(), d);
+        return;
+    }
+}
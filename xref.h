@@ -0,0 +1,56 @@
+/* File: xref.h
+ * ------------
+ * The cross-reference index (--xref=file, or --xref=- for standard
+ * output), for tools that search code. While the program is checked,
+ * each declaration checked and each name the checks resolve to one is
+ * written out as a line of tab-separated fields:
+ *
+ *    D  file  line:column  kind  name
+ *    U  file  line:column  file  line:column
+ *
+ * D is a declaration, of a variable, function, class or interface (kind
+ * var, fn, class or interface) at the location of its name. U is a use:
+ * the name at the first location, in a field access, a call, a new or a
+ * type, stands for the declaration whose name is at the second. The file
+ * is the source, or for a program of several (see imports.h), the one the
+ * name is in; a declaration preloaded from a module (see module.h) is
+ * said to be in the module.
+ *
+ * Lines are written as the checks go and nothing is kept, so the index
+ * can be any size. They come in the order of the checks, and with files
+ * checked on several threads, those of different files are interleaved.
+ * Only what is checked is indexed: the bodies skipped by
+ * --signatures-only are not, and neither is a program with syntax
+ * errors. With --incremental, a compile that writes the index checks
+ * everything again rather than reuse earlier checks. Through --client,
+ * the server writes the file, at the path made absolute by the client,
+ * and --xref=- comes back with the rest of the standard output; either
+ * way the source is named by its absolute path, as the server gets it.
+ */
+
+#ifndef _H_xref
+#define _H_xref
+
+class Decl;
+class Identifier;
+class Scope;
+class Type;
+
+// Whether the index is being written, which is only during a compile
+// with --xref
+extern bool writingXrefs;
+
+// Opens the index for the compile about to start, if there is to be
+// one, and closes it when the compile is done
+void BeginXrefs();
+void EndXrefs();
+
+// Writes out a declaration, or a use of name that stands for decl
+void NoteDeclaration(Decl *decl);
+void NoteUse(Identifier *name, Decl *decl);
+
+// Writes out a use of the class or interface that type, or its element
+// type for an array, names, if it is declared in scope or its parents
+void NoteTypeUse(Type *type, Scope *scope);
+
+#endif